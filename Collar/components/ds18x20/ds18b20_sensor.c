@@ -4,10 +4,13 @@
 #include "onewire.h"
 #include "ds18x20.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "driver/gpio.h"
 
 #define DS18B20_GPIO 4 // Your GPIO pin
 #define TAG "DS18B20"
+#define DS18B20_COMP_MAX_C 2.0f // Largest correction applied for the ambient temperature
+#define DS18B20_MAX_DEVICES 10
 
 // Temperature Sensor Initialization
 /**
@@ -30,47 +33,199 @@
 */
 
 gpio_num_t ds18b20_pin;
-onewire_addr_t addr_list[10];
+// ROM codes found by the last bus search, kept in RTC memory so warm wakes
+// skip the search. addr_check guards against a cold boot or corruption.
+static RTC_DATA_ATTR onewire_addr_t addr_list[DS18B20_MAX_DEVICES];
+static RTC_DATA_ATTR uint8_t addr_count = 0;
+static RTC_DATA_ATTR uint8_t addr_check = 0;
+// A parasite powered sensor needs the strong pull-up for the whole conversion
+// and cannot report when it is done
+static RTC_DATA_ATTR bool parasite_power = true;
+static bool conversion_pending = false;
+static bool conversion_started = false;
+static TickType_t conversion_start; // tick count when the last conversion was started
+static ds18b20_resolution_t resolution = DS18B20_RESOLUTION_12_BIT;
 
-void ds18b20_init_sensor()
+static uint8_t addr_list_crc(void)
 {
-    ds18b20_pin = DS18B20_GPIO;
-    // 1. Configure GPIO (critical step!)
-    gpio_reset_pin(DS18B20_GPIO);
-    gpio_set_direction(DS18B20_GPIO, GPIO_MODE_INPUT_OUTPUT_OD);
-    gpio_set_pull_mode(DS18B20_GPIO, GPIO_PULLUP_ONLY);
+    uint8_t crc = onewire_crc8((const uint8_t *)addr_list, sizeof(addr_list));
+    return crc ^ addr_count;
+}
+
+static bool addr_list_valid(void)
+{
+    if (addr_count == 0 || addr_count > DS18B20_MAX_DEVICES || addr_check != addr_list_crc())
+        return false;
+
+    // Each ROM code carries its own CRC in the top byte
+    for (int i = 0; i < addr_count; i++)
+    {
+        uint8_t rom[8];
+        for (int b = 0; b < 8; b++)
+            rom[b] = addr_list[i] >> (8 * b);
+        if (onewire_crc8(rom, 7) != rom[7])
+            return false;
+    }
+    return true;
+}
+
+static void addr_list_invalidate(void)
+{
+    addr_count = 0;
+    addr_check = 0;
+}
+
+// Address used for every transaction, a single sensor only needs SKIP ROM
+static onewire_addr_t sensor_addr(void)
+{
+    return addr_count == 1 ? DS18X20_ANY : addr_list[0];
+}
 
+static void scan_devices(void)
+{
     // 2. Verify bus functionality
-    if (!onewire_reset(DS18B20_GPIO))
+    if (!onewire_reset(ds18b20_pin))
     {
         ESP_LOGE(TAG, "No devices detected or bus fault");
+        addr_list_invalidate();
         return;
     }
 
-    // 3. Scan for devices (optional but recommended)
-    size_t found;
-    ds18x20_scan_devices(DS18B20_GPIO, addr_list, 10, &found);
+    // 3. Scan for devices
+    size_t found = 0;
+    ds18x20_scan_devices(ds18b20_pin, addr_list, DS18B20_MAX_DEVICES, &found);
 
     if (found == 0)
     {
         ESP_LOGW(TAG, "No DS18B20 devices found");
+        addr_list_invalidate();
     }
     else
     {
         ESP_LOGI(TAG, "Found %d DS18B20 devices", found);
+        addr_count = found < DS18B20_MAX_DEVICES ? found : DS18B20_MAX_DEVICES;
+        addr_check = addr_list_crc();
+
+        // Unknown counts as parasite, the conversion time is always safe
+        bool parasite = true;
+        if (ds18x20_read_power_supply(ds18b20_pin, DS18X20_ANY, &parasite) != ESP_OK)
+            ESP_LOGW(TAG, "Power supply read failed, assuming parasite power");
+        parasite_power = parasite;
+        ESP_LOGI(TAG, "%s power", parasite_power ? "Parasite" : "External");
     }
 }
 
-void getTemperature(float *temp)
+void ds18b20_init_sensor()
 {
-    onewire_addr_t addr = addr_list[0];
+    ds18b20_pin = DS18B20_GPIO;
+    // 1. Configure GPIO (critical step!)
+    gpio_reset_pin(DS18B20_GPIO);
+    gpio_set_direction(DS18B20_GPIO, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_pull_mode(DS18B20_GPIO, GPIO_PULLUP_ONLY);
+
+    // Warm wake, the bus is known. A failed transaction rescans.
+    if (addr_list_valid())
+        return;
+
+    scan_devices();
+}
+
+esp_err_t setTemperatureResolution(uint8_t bits)
+{
+    esp_err_t res = ds18b20_set_resolution(ds18b20_pin, sensor_addr(), (ds18b20_resolution_t)bits);
+    if (res == ESP_OK)
+    {
+        resolution = (ds18b20_resolution_t)bits;
+    }
+    else
+    {
+        // Unknown state, wait for the longest conversion
+        resolution = DS18B20_RESOLUTION_12_BIT;
+        ESP_LOGW(TAG, "Failed to set %d bit resolution: %s", bits, esp_err_to_name(res));
+    }
+    return res;
+}
+
+esp_err_t startTemperature(void)
+{
+    // A failed read dropped the cached addresses, find the sensors again
+    if (!addr_list_valid())
+        scan_devices();
 
     // Start conversion (non-blocking)
-    ds18x20_measure(ds18b20_pin, addr, false);
+    esp_err_t res = ds18x20_measure(ds18b20_pin, sensor_addr(), false);
+    if (res != ESP_OK)
+    {
+        // No presence pulse with the cached addresses, search the bus again
+        ESP_LOGW(TAG, "Conversion start failed, rescanning");
+        scan_devices();
+        res = ds18x20_measure(ds18b20_pin, sensor_addr(), false);
+    }
+    conversion_pending = res == ESP_OK;
+    conversion_started = conversion_pending;
+    conversion_start = xTaskGetTickCount();
+    return res;
+}
+
+uint32_t temperatureConversionMs(void)
+{
+    return ds18b20_conversion_time_ms(resolution);
+}
 
-    // Wait for conversion (750ms for 12-bit resolution)
-    vTaskDelay(pdMS_TO_TICKS(800));
+uint32_t temperatureAgeMs(void)
+{
+    if (!conversion_started)
+        return UINT32_MAX;
+    return pdTICKS_TO_MS(xTaskGetTickCount() - conversion_start);
+}
 
-    // Read temperature
-    esp_err_t res = ds18b20_read_temperature(ds18b20_pin, addr, temp);
-}
\ No newline at end of file
+bool temperatureReady(void)
+{
+    if (!conversion_pending)
+        return false;
+    // The conversion time is the upper bound
+    if (pdTICKS_TO_MS(xTaskGetTickCount() - conversion_start) >= temperatureConversionMs())
+        return true;
+    // Polling would drop the pull-up a parasite sensor is converting on
+    if (parasite_power)
+        return false;
+
+    bool done = false;
+    return ds18x20_conversion_done(ds18b20_pin, &done) == ESP_OK && done;
+}
+
+esp_err_t collectTemperature(float *temp)
+{
+    if (!conversion_pending)
+        return ESP_ERR_INVALID_STATE;
+    if (!temperatureReady())
+        return ESP_ERR_NOT_FINISHED;
+
+    conversion_pending = false;
+    esp_err_t res = ds18b20_read_temperature(ds18b20_pin, sensor_addr(), temp);
+    if (res != ESP_OK)
+    {
+        // Wrong device or bus trouble, search the bus on the next start
+        addr_list_invalidate();
+    }
+    return res;
+}
+
+void getTemperature(float *temp)
+{
+    if (startTemperature() != ESP_OK)
+        return;
+    while (!temperatureReady())
+        vTaskDelay(pdMS_TO_TICKS(10));
+    collectTemperature(temp);
+}
+
+float compensateTemperature(float body, float ambient, float k)
+{
+    float correction = k * (body - ambient);
+    if (correction > DS18B20_COMP_MAX_C)
+        correction = DS18B20_COMP_MAX_C;
+    if (correction < -DS18B20_COMP_MAX_C)
+        correction = -DS18B20_COMP_MAX_C;
+    return body + correction;
+}
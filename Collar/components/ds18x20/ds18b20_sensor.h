@@ -1,12 +1,60 @@
 #include "driver/gpio.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
 
 /**
  * Initiallize 
- * @param pin GPIO PIN Number of DS18B20
+ * The bus is searched on cold boot only, warm wakes reuse the ROM codes kept
+ * in RTC memory until a transaction fails.
  */
 void ds18b20_init_sensor();
 
 /**
- * Read the temperature (wait for 800 ms)
+ * Set the conversion resolution (9 to 12 bit), stored in the sensor EEPROM
+ * when it changes. The conversion time follows: 94, 188, 375 or 750 ms.
  */
-void getTemperature(float *);
\ No newline at end of file
+esp_err_t setTemperatureResolution(uint8_t bits);
+
+/**
+ * Start a conversion and return at once, collect it with collectTemperature()
+ */
+esp_err_t startTemperature(void);
+
+/**
+ * True once the pending conversion is done (read slot poll on externally
+ * powered sensors, the conversion time on parasite powered ones)
+ */
+bool temperatureReady(void);
+
+/**
+ * Read the result of the pending conversion
+ * @return ESP_ERR_NOT_FINISHED while converting, ESP_ERR_INVALID_STATE when nothing was started
+ */
+esp_err_t collectTemperature(float *temp);
+
+/**
+ * Milliseconds since the last conversion started, UINT32_MAX when there was none
+ */
+uint32_t temperatureAgeMs(void);
+
+/**
+ * Worst case conversion time at the current resolution (ms)
+ */
+uint32_t temperatureConversionMs(void);
+
+/**
+ * Read the temperature (blocks until the conversion is done)
+ */
+void getTemperature(float *);
+
+/**
+ * Correct the body contact temperature for heat exchange with the air.
+ * The collar side of the probe pulls the reading towards the ambient
+ * temperature, the core is estimated as body + k * (body - ambient),
+ * limited to +-2 degrees.
+ * @param body DS18B20 reading (Celsius)
+ * @param ambient temperature inside the collar housing (Celsius)
+ * @param k heat flux coefficient, 0 disables the correction
+ */
+float compensateTemperature(float body, float ambient, float k);
@@ -60,20 +60,13 @@
 #define ds18x20_ALARMSEARCH      0xEC
 #define ds18x20_CONVERT_T        0x44
 
+#define DS18B20_CONFIG_R_SHIFT   5    // R1:R0 resolution bits of the configuration register
+#define DS18B20_CONFIG_RESERVED  0x1F // Reserved bits, read back as ones
+
 #define SLEEP_MS(x) vTaskDelay(((x) + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS)
 #define CHECK(x) do { esp_err_t __; if ((__ = x) != ESP_OK) return __; } while (0)
 #define CHECK_ARG(VAL) do { if (!(VAL)) return ESP_ERR_INVALID_ARG; } while (0)
 
-#if HELPER_TARGET_IS_ESP32
-static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
-#define PORT_ENTER_CRITICAL portENTER_CRITICAL(&mux)
-#define PORT_EXIT_CRITICAL portEXIT_CRITICAL(&mux)
-
-#elif HELPER_TARGET_IS_ESP8266
-#define PORT_ENTER_CRITICAL portENTER_CRITICAL()
-#define PORT_EXIT_CRITICAL portEXIT_CRITICAL()
-#endif
-
 static const char *TAG = "ds18x20";
 
 esp_err_t ds18x20_measure(gpio_num_t pin, onewire_addr_t addr, bool wait)
@@ -86,12 +79,10 @@ esp_err_t ds18x20_measure(gpio_num_t pin, onewire_addr_t addr, bool wait)
     else
         onewire_select(pin, addr);
 
-    PORT_ENTER_CRITICAL;
-    onewire_write(pin, ds18x20_CONVERT_T);
     // For parasitic devices, power must be applied within 10us after issuing
     // the convert command.
-    onewire_power(pin);
-    PORT_EXIT_CRITICAL;
+    if (!onewire_write_power(pin, ds18x20_CONVERT_T))
+        return ESP_ERR_INVALID_RESPONSE;
 
     if (wait)
     {
@@ -102,6 +93,41 @@ esp_err_t ds18x20_measure(gpio_num_t pin, onewire_addr_t addr, bool wait)
     return ESP_OK;
 }
 
+esp_err_t ds18x20_read_power_supply(gpio_num_t pin, onewire_addr_t addr, bool *parasite)
+{
+    CHECK_ARG(parasite);
+
+    if (!onewire_reset(pin))
+        return ESP_ERR_INVALID_RESPONSE;
+
+    if (addr == DS18X20_ANY)
+        onewire_skip_rom(pin);
+    else
+        onewire_select(pin, addr);
+    onewire_write(pin, ds18x20_READ_PWRSUPPLY);
+
+    // Parasitically-powered devices pull the read slot low
+    int bit = onewire_read_bit(pin);
+    if (bit < 0)
+        return ESP_ERR_INVALID_RESPONSE;
+    *parasite = bit == 0;
+
+    return ESP_OK;
+}
+
+esp_err_t ds18x20_conversion_done(gpio_num_t pin, bool *done)
+{
+    CHECK_ARG(done);
+
+    onewire_depower(pin);
+    int bit = onewire_read_bit(pin);
+    if (bit < 0)
+        return ESP_ERR_INVALID_RESPONSE;
+    *done = bit != 0;
+
+    return ESP_OK;
+}
+
 esp_err_t ds18x20_read_scratchpad(gpio_num_t pin, onewire_addr_t addr, uint8_t *buffer)
 {
     CHECK_ARG(buffer);
@@ -162,12 +188,10 @@ esp_err_t ds18x20_copy_scratchpad(gpio_num_t pin, onewire_addr_t addr)
     else
         onewire_select(pin, addr);
 
-    PORT_ENTER_CRITICAL;
-    onewire_write(pin, ds18x20_COPY_SCRATCHPAD);
     // For parasitic devices, power must be applied within 10us after issuing
-    // the convert command.
-    onewire_power(pin);
-    PORT_EXIT_CRITICAL;
+    // the copy command.
+    if (!onewire_write_power(pin, ds18x20_COPY_SCRATCHPAD))
+        return ESP_ERR_INVALID_RESPONSE;
 
     // And then it needs to keep that power up for 10ms.
     SLEEP_MS(10);
@@ -176,6 +200,41 @@ esp_err_t ds18x20_copy_scratchpad(gpio_num_t pin, onewire_addr_t addr)
     return ESP_OK;
 }
 
+esp_err_t ds18b20_set_resolution(gpio_num_t pin, onewire_addr_t addr, ds18b20_resolution_t resolution)
+{
+    CHECK_ARG(resolution >= DS18B20_RESOLUTION_9_BIT && resolution <= DS18B20_RESOLUTION_12_BIT);
+
+    uint8_t scratchpad[8];
+    CHECK(ds18x20_read_scratchpad(pin, addr, scratchpad));
+
+    uint8_t config = ((resolution - DS18B20_RESOLUTION_9_BIT) << DS18B20_CONFIG_R_SHIFT) | DS18B20_CONFIG_RESERVED;
+    if (scratchpad[4] == config)
+        return ESP_OK;
+
+    // TH and TL are written along with the configuration, keep them
+    uint8_t buffer[3] = { scratchpad[2], scratchpad[3], config };
+    CHECK(ds18x20_write_scratchpad(pin, addr, buffer));
+    CHECK(ds18x20_copy_scratchpad(pin, addr));
+    ESP_LOGI(TAG, "Resolution set to %d bit", resolution);
+
+    return ESP_OK;
+}
+
+uint32_t ds18b20_conversion_time_ms(ds18b20_resolution_t resolution)
+{
+    switch (resolution)
+    {
+        case DS18B20_RESOLUTION_9_BIT:
+            return 94;
+        case DS18B20_RESOLUTION_10_BIT:
+            return 188;
+        case DS18B20_RESOLUTION_11_BIT:
+            return 375;
+        default:
+            return 750;
+    }
+}
+
 esp_err_t ds18s20_read_temperature(gpio_num_t pin, onewire_addr_t addr, float *temperature)
 {
     CHECK_ARG(temperature);
@@ -197,6 +256,9 @@ esp_err_t ds18b20_read_temperature(gpio_num_t pin, onewire_addr_t addr, float *t
     CHECK(ds18x20_read_scratchpad(pin, addr, scratchpad));
 
     uint16_t temp = scratchpad[1] << 8 | scratchpad[0];
+    // Below 12 bits the lowest bits are undefined
+    int resolution = (scratchpad[4] >> DS18B20_CONFIG_R_SHIFT) & 0x03;
+    temp &= ~((1 << (3 - resolution)) - 1);
     int sign = 1;
     if (temp > 2047)
     {
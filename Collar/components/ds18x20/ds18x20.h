@@ -65,6 +65,14 @@ typedef enum {
     DS18X20_FAMILY_MAX31850 = 0x3b, //!< MAX31850        14-bit +/-0.25°C
 } ds18x20_family_id_t;
 
+/** DS18B20/DS1822 conversion resolution, traded against conversion time */
+typedef enum {
+    DS18B20_RESOLUTION_9_BIT  = 9,  //!< 0.5°C,    94 ms
+    DS18B20_RESOLUTION_10_BIT = 10, //!< 0.25°C,   188 ms
+    DS18B20_RESOLUTION_11_BIT = 11, //!< 0.125°C,  375 ms
+    DS18B20_RESOLUTION_12_BIT = 12, //!< 0.0625°C, 750 ms (power-up default)
+} ds18b20_resolution_t;
+
 /**
  * @brief Find the addresses of all ds18x20 devices on the bus.
  *
@@ -113,6 +121,34 @@ esp_err_t ds18x20_scan_devices(gpio_num_t pin, onewire_addr_t *addr_list, size_t
  */
 esp_err_t ds18x20_measure(gpio_num_t pin, onewire_addr_t addr, bool wait);
 
+/**
+ * @brief Find out whether any of the addressed devices is parasitically powered
+ * (READ POWER SUPPLY).
+ *
+ * @param pin   The GPIO pin connected to the DS18x20 device
+ * @param addr  The 64-bit address of the device on the bus, or ::DS18X20_ANY
+ *              to ask every device at once
+ * @param[out] parasite `true` when a device draws its power from the bus
+ *
+ * @returns `ESP_OK` if the command was successfully issued
+ */
+esp_err_t ds18x20_read_power_supply(gpio_num_t pin, onewire_addr_t addr, bool *parasite);
+
+/**
+ * @brief Check whether the conversion started by ds18x20_measure() is done.
+ *
+ * Depowers the bus and issues one read time slot, externally powered devices
+ * hold it low until the conversion is complete. Only use it on externally
+ * powered devices: depowering starves a parasitically-powered conversion and
+ * the released bus reads as done. Wait out the conversion time for those.
+ *
+ * @param pin   The GPIO pin connected to the DS18x20 device
+ * @param[out] done `true` once the conversion has finished
+ *
+ * @returns `ESP_OK` if the read slot could be issued
+ */
+esp_err_t ds18x20_conversion_done(gpio_num_t pin, bool *done);
+
 /**
  * @brief Read the value from the last CONVERT_T operation.
  *
@@ -302,6 +338,32 @@ esp_err_t ds18x20_write_scratchpad(gpio_num_t pin, onewire_addr_t addr, uint8_t
  */
 esp_err_t ds18x20_copy_scratchpad(gpio_num_t pin, onewire_addr_t addr);
 
+/**
+ * @brief Set the conversion resolution of a DS18B20/DS1822 device.
+ *
+ * Reads the scratchpad first and only writes the configuration register
+ * (keeping the alarm bytes) when it differs, then copies it to EEPROM so
+ * the device powers up at this resolution. Calling it on every boot costs
+ * one scratchpad read once the setting is stored.
+ *
+ * @param pin         The GPIO pin connected to the DS18B20 device
+ * @param addr        The 64-bit address of the device to configure. This can be
+ *                    set to ::DS18X20_ANY if there is exactly one device on the bus
+ * @param resolution  Resolution to set
+ *
+ * @returns `ESP_OK` if the device is at the requested resolution
+ */
+esp_err_t ds18b20_set_resolution(gpio_num_t pin, onewire_addr_t addr, ds18b20_resolution_t resolution);
+
+/**
+ * @brief Worst case DS18B20/DS1822 conversion time at a resolution.
+ *
+ * @param resolution  Resolution the device is set to
+ *
+ * @returns Conversion time in milliseconds
+ */
+uint32_t ds18b20_conversion_time_ms(ds18b20_resolution_t resolution);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,143 @@
+#include <math.h>
+#include <string.h>
+#include "beatIntervals.h"
+
+#define HRV_ARTIFACT_TOLERANCE 0.20f
+#define HRV_MIN_MS 250  // 240 bpm
+#define HRV_MAX_MS 2000 // 30 bpm
+#define HRV_NN50_MS 50
+
+void ibiReset(beat_intervals_t *b)
+{
+  b->head = 0;
+  b->count = 0;
+}
+
+void ibiAdd(beat_intervals_t *b, uint16_t interval_ms)
+{
+  b->ms[b->head] = interval_ms;
+  b->head = (b->head + 1) % IBI_MAX_BEATS;
+  if (b->count < IBI_MAX_BEATS)
+    b->count++;
+}
+
+uint16_t ibiRecent(const beat_intervals_t *b, uint8_t n)
+{
+  return b->ms[(b->head + IBI_MAX_BEATS - 1 - n) % IBI_MAX_BEATS];
+}
+
+float ibiVariation(const beat_intervals_t *b, uint8_t n)
+{
+  if (n < 2 || b->count < n)
+    return -1;
+
+  float sum = 0, sum_sq = 0;
+  for (uint8_t i = 0; i < n; i++)
+  {
+    float x = ibiRecent(b, i);
+    sum += x;
+    sum_sq += x * x;
+  }
+
+  float mean = sum / n;
+  float var = sum_sq / n - mean * mean;
+  if (var < 0)
+    var = 0;
+  return sqrtf(var) / mean;
+}
+
+bool ibiConverged(const beat_intervals_t *b, uint8_t n, float tolerance)
+{
+  if (n == 0 || b->count < n)
+    return false;
+
+  float mean = 0;
+  for (uint8_t i = 0; i < n; i++)
+    mean += ibiRecent(b, i);
+  mean /= n;
+
+  for (uint8_t i = 0; i < n; i++)
+  {
+    float x = ibiRecent(b, i);
+    if (x < mean * (1 - tolerance) || x > mean * (1 + tolerance))
+      return false;
+  }
+  return true;
+}
+
+static uint16_t ibiMedian(const beat_intervals_t *b)
+{
+  uint16_t sorted[IBI_MAX_BEATS];
+  uint8_t n = b->count;
+  for (uint8_t i = 0; i < n; i++)
+    sorted[i] = ibiRecent(b, i);
+
+  // Insertion sort, at most IBI_MAX_BEATS values
+  for (uint8_t i = 1; i < n; i++)
+  {
+    uint16_t x = sorted[i];
+    int8_t j = i - 1;
+    while (j >= 0 && sorted[j] > x)
+    {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = x;
+  }
+  return sorted[n / 2];
+}
+
+bool ibiHrv(const beat_intervals_t *b, hrv_t *hrv)
+{
+  memset(hrv, 0, sizeof(*hrv));
+  if (b->count < HRV_MIN_INTERVALS)
+    return false;
+
+  float median = ibiMedian(b);
+  float low = median * (1 - HRV_ARTIFACT_TOLERANCE);
+  float high = median * (1 + HRV_ARTIFACT_TOLERANCE);
+
+  float sum = 0, sum_sq = 0, diff_sq = 0;
+  uint8_t clean = 0, diffs = 0, nn50 = 0;
+  bool previous_clean = false;
+  uint16_t previous = 0;
+
+  // Oldest to newest so successive differences follow the beat order
+  for (int16_t i = b->count - 1; i >= 0; i--)
+  {
+    uint16_t x = ibiRecent(b, i);
+    if (x < HRV_MIN_MS || x > HRV_MAX_MS || x < low || x > high)
+    {
+      previous_clean = false;
+      continue;
+    }
+
+    clean++;
+    sum += x;
+    sum_sq += (float)x * x;
+    if (previous_clean)
+    {
+      float d = (float)x - previous;
+      diff_sq += d * d;
+      diffs++;
+      if (fabsf(d) > HRV_NN50_MS)
+        nn50++;
+    }
+    previous = x;
+    previous_clean = true;
+  }
+
+  if (clean < HRV_MIN_INTERVALS || diffs == 0)
+    return false;
+
+  float mean = sum / clean;
+  float var = sum_sq / clean - mean * mean;
+  if (var < 0)
+    var = 0;
+
+  hrv->rmssd_ms = (uint16_t)(sqrtf(diff_sq / diffs) + 0.5f);
+  hrv->sdnn_ms = (uint16_t)(sqrtf(var) + 0.5f);
+  hrv->pnn50 = (uint8_t)(100 * nn50 / diffs);
+  hrv->intervals = clean;
+  return true;
+}
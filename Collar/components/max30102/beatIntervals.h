@@ -0,0 +1,48 @@
+#ifndef BEAT_INTERVALS_H
+#define BEAT_INTERVALS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IBI_MAX_BEATS 64 // Inter-beat intervals kept for one measurement window
+#define HRV_MIN_INTERVALS 20 // Clean intervals needed before HRV is reported
+#define HRV_MIN_WINDOW_S 30  // Shortest window HRV is reported from
+
+// Ring of the most recent inter-beat intervals (ms)
+typedef struct
+{
+  uint16_t ms[IBI_MAX_BEATS];
+  uint8_t head;  // next slot to write
+  uint8_t count; // valid intervals, saturates at IBI_MAX_BEATS
+} beat_intervals_t;
+
+// Time domain heart rate variability of one window
+typedef struct
+{
+  uint16_t rmssd_ms; // root mean square of successive differences
+  uint16_t sdnn_ms;  // standard deviation of the intervals
+  uint8_t pnn50;     // successive differences above 50 ms (%)
+  uint8_t intervals; // clean intervals used
+} hrv_t;
+
+void ibiReset(beat_intervals_t *b);
+void ibiAdd(beat_intervals_t *b, uint16_t interval_ms);
+
+//  Interval n beats back from the newest one (0 = newest)
+uint16_t ibiRecent(const beat_intervals_t *b, uint8_t n);
+
+//  Coefficient of variation (std / mean) of the last n intervals,
+//  returns a negative value when fewer than n intervals are available
+float ibiVariation(const beat_intervals_t *b, uint8_t n);
+
+//  True once the last n intervals all lie within +-tolerance (fraction)
+//  of their mean, i.e. the heart rate estimate has converged
+bool ibiConverged(const beat_intervals_t *b, uint8_t n, float tolerance);
+
+//  HRV of all stored intervals. Intervals more than 20% away from the median
+//  (missed or extra beats, motion) are rejected, successive differences are
+//  only taken between neighbouring clean intervals. Returns false when fewer
+//  than HRV_MIN_INTERVALS clean intervals are left.
+bool ibiHrv(const beat_intervals_t *b, hrv_t *hrv);
+
+#endif
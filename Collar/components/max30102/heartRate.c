@@ -1,3 +1,4 @@
+#include <math.h>
 #include "heartRate.h"
 
 int16_t IR_AC_Max = 20;
@@ -79,6 +80,24 @@ bool checkForBeat(int32_t sample)
   return (beatDetected);
 }
 
+//  Clear the detector state before a new measurement window
+void checkForBeatReset(void)
+{
+  IR_AC_Max = 20;
+  IR_AC_Min = -20;
+  IR_AC_Signal_Current = 0;
+  IR_AC_Signal_Previous = 0;
+  IR_AC_Signal_min = 0;
+  IR_AC_Signal_max = 0;
+  IR_Average_Estimated = 0;
+  positiveEdge = 0;
+  negativeEdge = 0;
+  ir_avg_reg = 0;
+  for (uint8_t i = 0; i < 32; i++)
+    cbuf[i] = 0;
+  offset = 0;
+}
+
 //  Average DC Estimator
 int16_t averageDCEstimator(int32_t *p, uint16_t x)
 {
@@ -112,3 +131,41 @@ int32_t mul16(int16_t x, int16_t y)
 {
   return ((long)x * (long)y);
 }
+
+//  Slow DC tracker for the AC/DC statistics (time constant ~1.3 s at 100 Hz),
+//  long enough that the pulse itself stays in the AC part
+#define PPG_CHANNEL_DC_SHIFT 7
+
+void ppgChannelReset(ppg_channel_t *ch)
+{
+  ch->dc_reg = 0;
+  ch->count = 0;
+  ch->dc_sum = 0;
+  ch->ac_sq_sum = 0;
+}
+
+void ppgChannelAdd(ppg_channel_t *ch, uint16_t sample)
+{
+  // Start the tracker at the first sample so there is no settling transient
+  if (ch->count == 0)
+    ch->dc_reg = (int32_t)sample << 15;
+  else
+    ch->dc_reg += (int32_t)((((int64_t)sample << 15) - ch->dc_reg) >> PPG_CHANNEL_DC_SHIFT);
+
+  int32_t dc = ch->dc_reg >> 15;
+  int32_t ac = (int32_t)sample - dc;
+
+  ch->dc_sum += dc;
+  ch->ac_sq_sum += (int64_t)ac * ac;
+  ch->count++;
+}
+
+float ppgChannelDC(const ppg_channel_t *ch)
+{
+  return ch->count ? (float)ch->dc_sum / ch->count : 0;
+}
+
+float ppgChannelACrms(const ppg_channel_t *ch)
+{
+  return ch->count ? sqrtf((float)ch->ac_sq_sum / ch->count) : 0;
+}
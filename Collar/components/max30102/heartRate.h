@@ -1,7 +1,27 @@
+#ifndef HEART_RATE_H
+#define HEART_RATE_H
+
 #include <stdbool.h>
 #include <stdint.h>
 
 bool checkForBeat(int32_t sample);
+void checkForBeatReset(void);
 int16_t averageDCEstimator(int32_t *p, uint16_t x);
 int16_t lowPassFIRFilter(int16_t din);
-int32_t mul16(int16_t x, int16_t y);
\ No newline at end of file
+int32_t mul16(int16_t x, int16_t y);
+
+// Running AC/DC statistics of one PPG channel over a measurement window
+typedef struct
+{
+  int32_t dc_reg;     // slow DC estimator state (Q15)
+  uint32_t count;     // samples accumulated
+  int64_t dc_sum;     // sum of the DC estimates
+  int64_t ac_sq_sum;  // sum of the squared AC component
+} ppg_channel_t;
+
+void ppgChannelReset(ppg_channel_t *ch);
+void ppgChannelAdd(ppg_channel_t *ch, uint16_t sample);
+float ppgChannelDC(const ppg_channel_t *ch);
+float ppgChannelACrms(const ppg_channel_t *ch);
+
+#endif
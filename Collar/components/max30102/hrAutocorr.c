@@ -0,0 +1,113 @@
+#include "hrAutocorr.h"
+
+#define HR_AC_DC_SHIFT 4 // ~0.25 Hz high pass at 25 Hz
+
+//  Lags (in decimated samples) covering HR_AC_MAX_BPM..HR_AC_MIN_BPM
+#define HR_AC_MIN_LAG (HR_AC_RATE_HZ * 60 / HR_AC_MAX_BPM)
+#define HR_AC_MAX_LAG (HR_AC_RATE_HZ * 60 / HR_AC_MIN_BPM)
+
+//  A shorter lag is preferred over the global maximum when its correlation is
+//  at least this fraction of it, so harmonics of the period are not picked
+#define HR_AC_HARMONIC_RATIO 0.85f
+
+void hrAutocorrInit(hr_autocorr_t *ac)
+{
+  ac->head = 0;
+  ac->count = 0;
+  ac->dc_reg = 0;
+  ac->decim_acc = 0;
+  ac->decim_count = 0;
+  ac->primed = false;
+}
+
+void hrAutocorrAddSample(hr_autocorr_t *ac, uint16_t ir)
+{
+  ac->decim_acc += ir;
+  if (++ac->decim_count < HR_AC_DECIMATION)
+    return;
+
+  // Block average doubles as the anti-alias filter
+  int32_t x = ac->decim_acc / HR_AC_DECIMATION;
+  ac->decim_acc = 0;
+  ac->decim_count = 0;
+
+  if (!ac->primed)
+  {
+    ac->dc_reg = x << 8;
+    ac->primed = true;
+  }
+  ac->dc_reg += ((x << 8) - ac->dc_reg) >> HR_AC_DC_SHIFT;
+  int32_t y = x - (ac->dc_reg >> 8);
+  if (y > INT16_MAX)
+    y = INT16_MAX;
+  if (y < INT16_MIN)
+    y = INT16_MIN;
+
+  ac->buf[ac->head] = (int16_t)y;
+  ac->head = (ac->head + 1) % HR_AC_LEN;
+  if (ac->count < HR_AC_LEN)
+    ac->count++;
+}
+
+//  Sample i of the window in time order (0 = oldest)
+static inline int32_t hrAutocorrAt(const hr_autocorr_t *ac, uint16_t i)
+{
+  return ac->buf[(ac->head + HR_AC_LEN - ac->count + i) % HR_AC_LEN];
+}
+
+static int64_t hrAutocorrLag(const hr_autocorr_t *ac, uint16_t lag)
+{
+  int64_t r = 0;
+  for (uint16_t i = 0; i + lag < ac->count; i++)
+    r += hrAutocorrAt(ac, i) * hrAutocorrAt(ac, i + lag);
+  return r;
+}
+
+bool hrAutocorrEstimate(const hr_autocorr_t *ac, float *bpm, uint8_t *confidence)
+{
+  *bpm = 0;
+  *confidence = 0;
+
+  // Need at least one and a half of the longest period
+  if (ac->count < HR_AC_MAX_LAG * 3 / 2)
+    return false;
+
+  int64_t r0 = hrAutocorrLag(ac, 0);
+  if (r0 <= 0)
+    return false;
+
+  // Normalised autocorrelation, corrected for the shrinking overlap
+  float r[HR_AC_MAX_LAG + 2];
+  for (uint16_t lag = HR_AC_MIN_LAG - 1; lag <= HR_AC_MAX_LAG + 1; lag++)
+    r[lag] = (float)hrAutocorrLag(ac, lag) / r0 * ac->count / (ac->count - lag);
+
+  float best = 0;
+  for (uint16_t lag = HR_AC_MIN_LAG; lag <= HR_AC_MAX_LAG; lag++)
+    if (r[lag] > best)
+      best = r[lag];
+  if (best <= 0)
+    return false;
+
+  // First local maximum that is close enough to the global one
+  uint16_t peak = 0;
+  for (uint16_t lag = HR_AC_MIN_LAG; lag <= HR_AC_MAX_LAG; lag++)
+  {
+    if (r[lag] >= r[lag - 1] && r[lag] >= r[lag + 1] && r[lag] >= best * HR_AC_HARMONIC_RATIO)
+    {
+      peak = lag;
+      break;
+    }
+  }
+  if (peak == 0)
+    return false;
+
+  // Parabolic interpolation around the peak for sub-lag resolution
+  float a = r[peak - 1], b = r[peak], c = r[peak + 1];
+  float denom = a - 2 * b + c;
+  float offset = denom < 0 ? 0.5f * (a - c) / denom : 0;
+  float period = (peak + offset) / HR_AC_RATE_HZ;
+
+  *bpm = 60.0f / period;
+  *confidence = b >= 1.0f ? 100 : (uint8_t)(b * 100);
+  return true;
+}
@@ -0,0 +1,37 @@
+#ifndef HR_AUTOCORR_H
+#define HR_AUTOCORR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//  Autocorrelation heart rate estimator. The 100 Hz IR stream is decimated to
+//  25 Hz and the last HR_AC_WINDOW_S seconds are kept in a fixed ring buffer.
+#define HR_AC_DECIMATION 4
+#define HR_AC_RATE_HZ (100 / HR_AC_DECIMATION)
+#define HR_AC_WINDOW_S 8
+#define HR_AC_LEN (HR_AC_RATE_HZ * HR_AC_WINDOW_S)
+
+//  Searched heart rate range
+#define HR_AC_MIN_BPM 30
+#define HR_AC_MAX_BPM 200
+
+typedef struct
+{
+  int16_t buf[HR_AC_LEN]; // high passed, decimated IR
+  uint16_t head;          // next slot to write
+  uint16_t count;         // valid samples in buf
+  int32_t dc_reg;         // DC removal state (Q8)
+  int32_t decim_acc;      // sum of the samples of the current decimation block
+  uint8_t decim_count;
+  bool primed;
+} hr_autocorr_t;
+
+void hrAutocorrInit(hr_autocorr_t *ac);
+void hrAutocorrAddSample(hr_autocorr_t *ac, uint16_t ir);
+
+//  Estimate the heart rate from the buffered window. confidence is the
+//  normalised autocorrelation at the chosen lag (0..100).
+//  Returns false when there is not enough data yet.
+bool hrAutocorrEstimate(const hr_autocorr_t *ac, float *bpm, uint8_t *confidence);
+
+#endif
@@ -0,0 +1,126 @@
+#include "hrEngine.h"
+#include "heartRate.h"
+
+//  Confidence of the zero crossing engine from the beat interval variation:
+//  full below GOOD, zero above MAX
+#define HR_ZC_REGULARITY_BEATS 4
+#define HR_ZC_CV_GOOD 0.10f
+#define HR_ZC_CV_MAX 0.30f
+
+void hrEngineInit(hr_engine_t *e, hr_engine_type_t type)
+{
+  e->type = type;
+  checkForBeatReset();
+
+  ibiReset(&e->intervals);
+  e->last_beat_us = 0;
+  for (uint8_t i = 0; i < HR_RATE_SIZE; i++)
+    e->rates[i] = 0;
+  e->rate_spot = 0;
+  e->beat_avg = 0;
+  e->contact = false;
+
+  hrAutocorrInit(&e->autocorr);
+  e->ac_bpm = 0;
+  e->ac_confidence = 0;
+  ibiReset(&e->ac_periods);
+  e->ac_fresh = 0;
+}
+
+bool hrEngineAddSample(hr_engine_t *e, uint16_t ir, int64_t t_us)
+{
+  bool beat = false;
+
+  if (checkForBeat(ir))
+  {
+    int64_t delta = (t_us - e->last_beat_us) / 1000; // ms
+    e->last_beat_us = t_us;
+
+    if (delta > 0)
+    {                              // Prevent division by zero
+      float bpm = 60000.0 / delta; // Correct BPM calculation
+      if (bpm > 20 && bpm < 255)
+      {
+        beat = true;
+        ibiAdd(&e->intervals, (uint16_t)delta);
+        e->rates[e->rate_spot++] = (uint8_t)bpm;
+        e->rate_spot %= HR_RATE_SIZE;
+
+        // Update average
+        e->beat_avg = 0;
+        for (uint8_t x = 0; x < HR_RATE_SIZE; x++)
+          e->beat_avg += e->rates[x];
+        e->beat_avg /= HR_RATE_SIZE;
+      }
+    }
+  }
+
+  e->contact = ir >= HR_NO_CONTACT;
+  if (!e->contact)
+    e->beat_avg = 0;
+
+  if (e->type == HR_ENGINE_AUTOCORR)
+  {
+    hrAutocorrAddSample(&e->autocorr, ir);
+    if (e->ac_fresh < UINT16_MAX)
+      e->ac_fresh++;
+  }
+
+  return beat;
+}
+
+void hrEngineUpdate(hr_engine_t *e)
+{
+  if (e->type != HR_ENGINE_AUTOCORR)
+    return;
+
+  float bpm;
+  uint8_t confidence;
+  if (!hrAutocorrEstimate(&e->autocorr, &bpm, &confidence))
+  {
+    e->ac_bpm = 0;
+    e->ac_confidence = 0;
+    ibiReset(&e->ac_periods);
+    e->ac_fresh = 0;
+    return;
+  }
+
+  // Every HR_AC_CONVERGE_STEP samples, not every batch
+  if (e->ac_periods.count == 0 || e->ac_fresh >= HR_AC_CONVERGE_STEP)
+  {
+    ibiAdd(&e->ac_periods, (uint16_t)(60000.0f / bpm));
+    e->ac_fresh = 0;
+  }
+  e->ac_bpm = bpm;
+  e->ac_confidence = confidence;
+}
+
+int hrEngineBpm(const hr_engine_t *e, uint8_t *confidence)
+{
+  *confidence = 0;
+  if (!e->contact)
+    return 0;
+
+  if (e->type == HR_ENGINE_AUTOCORR)
+  {
+    *confidence = e->ac_confidence;
+    return (int)(e->ac_bpm + 0.5f);
+  }
+
+  float cv = ibiVariation(&e->intervals, HR_ZC_REGULARITY_BEATS);
+  if (cv < 0)
+    *confidence = 0;
+  else if (cv <= HR_ZC_CV_GOOD)
+    *confidence = 100;
+  else if (cv < HR_ZC_CV_MAX)
+    *confidence = (uint8_t)(100 * (HR_ZC_CV_MAX - cv) / (HR_ZC_CV_MAX - HR_ZC_CV_GOOD));
+  return e->beat_avg;
+}
+
+bool hrEngineConverged(const hr_engine_t *e, uint8_t n, float tolerance)
+{
+  if (e->type == HR_ENGINE_AUTOCORR)
+    return ibiConverged(&e->ac_periods, HR_AC_CONVERGE_WINDOWS, tolerance);
+
+  return ibiConverged(&e->intervals, n, tolerance);
+}
@@ -0,0 +1,60 @@
+#ifndef HR_ENGINE_H
+#define HR_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "beatIntervals.h"
+#include "hrAutocorr.h"
+
+#define HR_RATE_SIZE 4     // Moving average window of the zero crossing engine
+#define HR_NO_CONTACT 500  // IR level below which there is no tissue on the sensor
+#define HR_AC_CONVERGE_WINDOWS 3 // Successive autocorrelation estimates that must agree
+#define HR_AC_CONVERGE_STEP 50   // IR samples (0.5 s) between the estimates kept for convergence
+
+//  Heart rate estimators, selectable at runtime
+typedef enum
+{
+  HR_ENGINE_ZERO_CROSSING = 0, // checkForBeat() with a moving average of the beats
+  HR_ENGINE_AUTOCORR = 1       // Windowed autocorrelation peak of the IR signal
+} hr_engine_type_t;
+
+typedef struct
+{
+  hr_engine_type_t type;
+
+  // Beat detection always runs, its intervals feed quality and convergence
+  beat_intervals_t intervals;
+  int64_t last_beat_us;
+  uint8_t rates[HR_RATE_SIZE];
+  uint8_t rate_spot;
+  int beat_avg;
+  bool contact;
+
+  // Autocorrelation engine
+  hr_autocorr_t autocorr;
+  float ac_bpm;
+  uint8_t ac_confidence;
+  beat_intervals_t ac_periods; // estimates HR_AC_CONVERGE_STEP apart as periods (ms) for convergence
+  uint16_t ac_fresh;           // samples since the last estimate kept for convergence
+} hr_engine_t;
+
+void hrEngineInit(hr_engine_t *e, hr_engine_type_t type);
+
+//  Feed one IR sample taken at t_us. Returns true when a beat was detected.
+bool hrEngineAddSample(hr_engine_t *e, uint16_t ir, int64_t t_us);
+
+//  Refresh the estimate, call once per batch of samples
+void hrEngineUpdate(hr_engine_t *e);
+
+//  Current heart rate (0 when there is none) and its confidence (0..100)
+int hrEngineBpm(const hr_engine_t *e, uint8_t *confidence);
+
+//  True when the estimate has converged: for the zero crossing engine the last
+//  n beat intervals agree within +-tolerance. The autocorrelation engine
+//  compares its last HR_AC_CONVERGE_WINDOWS estimates instead of n, taken
+//  HR_AC_CONVERGE_STEP samples apart. Those windows overlap (disjoint 8 s
+//  windows never fit in a heart rate window) but each adds a new stretch of
+//  signal, the first one being available after 3 s.
+bool hrEngineConverged(const hr_engine_t *e, uint8_t n, float tolerance);
+
+#endif
@@ -0,0 +1,60 @@
+#include "ledAgc.h"
+
+#define AGC_CLIP_LEVEL 65000 // Same clip level the signal quality index uses
+#define AGC_NO_CONTACT 500   // No tissue, raising the current would only waste power
+
+void agcInit(led_agc_t *agc, uint8_t pa)
+{
+  if (pa < AGC_PA_MIN)
+    pa = AGC_PA_MIN;
+  agc->pa = pa;
+  agc->good_pa = 0;
+  agc->settle = AGC_SETTLE_BATCHES;
+}
+
+bool agcUpdate(led_agc_t *agc, const uint16_t samples[], size_t count)
+{
+  if (count == 0)
+    return false;
+  if (agc->settle > 0)
+  {
+    agc->settle--;
+    return false;
+  }
+
+  uint32_t sum = 0;
+  bool clipped = false;
+  for (size_t i = 0; i < count; i++)
+  {
+    sum += samples[i];
+    if (samples[i] >= AGC_CLIP_LEVEL)
+      clipped = true;
+  }
+  uint32_t dc = sum / count;
+
+  if (dc < AGC_NO_CONTACT)
+    return false;
+  if (!clipped && dc >= AGC_DC_LOW && dc <= AGC_DC_HIGH)
+  {
+    agc->good_pa = agc->pa;
+    return false;
+  }
+
+  // DC scales with the LED current, aim for the middle of the band but
+  // never more than halve or double the current in one step
+  uint32_t pa = clipped ? agc->pa / 2 : (uint32_t)agc->pa * AGC_DC_TARGET / dc;
+  if (pa > (uint32_t)agc->pa * 2)
+    pa = (uint32_t)agc->pa * 2;
+  if (pa < agc->pa / 2)
+    pa = agc->pa / 2;
+  if (pa < AGC_PA_MIN)
+    pa = AGC_PA_MIN;
+  if (pa > AGC_PA_MAX)
+    pa = AGC_PA_MAX;
+
+  if (pa == agc->pa)
+    return false;
+  agc->pa = (uint8_t)pa;
+  agc->settle = AGC_SETTLE_BATCHES;
+  return true;
+}
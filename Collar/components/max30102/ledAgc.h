@@ -0,0 +1,35 @@
+#ifndef LED_AGC_H
+#define LED_AGC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//  DC band (16 bit FIFO counts) the AGC holds each LED channel in
+#define AGC_DC_LOW 20000
+#define AGC_DC_TARGET 35000
+#define AGC_DC_HIGH 50000
+
+//  LED pulse amplitude register limits, 0.2 mA per step
+#define AGC_PA_MIN 0x05 // 1 mA
+#define AGC_PA_MAX 0xFF // 51 mA
+
+#define AGC_SETTLE_BATCHES 2 // Batches ignored after a change while the LED settles
+
+#define AGC_PA_TO_MA(pa) ((pa) * 0.2f)
+
+//  Closed loop LED current control of one channel
+typedef struct
+{
+  uint8_t pa;      // current setting (PA register code)
+  uint8_t good_pa; // last setting that put the DC inside the band, 0 if none yet
+  uint8_t settle;  // batches left before the DC is evaluated again
+} led_agc_t;
+
+void agcInit(led_agc_t *agc, uint8_t pa);
+
+//  Evaluate one batch of samples of the channel. Returns true when agc->pa
+//  changed and has to be written to the sensor.
+bool agcUpdate(led_agc_t *agc, const uint16_t samples[], size_t count);
+
+#endif
@@ -33,7 +33,7 @@ esp_err_t max30102_init(max30102_t *this, i2c_port_t i2c_num)
     memset(this->_ir_samples, 0, MAX30102_SAMPLE_LEN_MAX * sizeof(uint32_t));
     memset(this->_red_samples, 0, MAX30102_SAMPLE_LEN_MAX * sizeof(uint32_t));
 
-    esp_err_t ret = max30102_write_register(this,MAX30102_INTERRUPT_ENABLE_1,PROX_INT_EN);
+    esp_err_t ret = max30102_write_register(this,MAX30102_INTERRUPT_ENABLE_1,FIFO_A_FULL_EN | PROX_INT_EN);
     if(ret != ESP_OK) return ret;
     ret = max30102_write_register(this,MAX30102_FIFO_WR_PTR,0x00);
     if(ret != ESP_OK) return ret;
@@ -55,10 +55,19 @@ esp_err_t max30102_init(max30102_t *this, i2c_port_t i2c_num)
     if(ret != ESP_OK) return ret;
     ret = max30102_set_led_current(this, MAX30102_LED_CURRENT_11MA, MAX30102_LED_CURRENT_11MA);
     if(ret != ESP_OK) return ret;
+    ret = max30102_set_proximity(this, MAX30102_PILOT_CURRENT, MAX30102_PROX_THRESH);
+    if(ret != ESP_OK) return ret;
 
     return ret;
 }
 
+esp_err_t max30102_set_proximity(max30102_t *this, max30102_current_t pilot_current, uint8_t threshold)
+{
+    esp_err_t ret = max30102_write_register(this, MAX30102_PILOT_PA, pilot_current);
+    if(ret != ESP_OK) return ret;
+    return max30102_write_register(this, REG_PROX_INT_THRESH, threshold);
+}
+
 /**
  * @brief MAX30102 shutdown function (puts sensor in low-power mode)
  * 
@@ -317,6 +326,72 @@ esp_err_t max30102_read_fifo(i2c_port_t i2c_num, uint16_t sensorDataRED[],uint16
 }
 
 
+// Convert one 3 byte FIFO word into the same 16 bit scale as max30102_read_fifo
+static inline uint16_t max30102_fifo_word(const uint8_t *word)
+{
+	return ((((word[0] & 0b00000011) << 16) + (word[1] << 8) + word[2]) >> (18 - SPO2_RES) << (18 - SPO2_RES)) >> 2;
+}
+
+esp_err_t max30102_read_fifo_burst(max30102_t* this, uint16_t sensorDataRED[], uint16_t sensorDataIR[], size_t max_samples, size_t *count)
+{
+	uint8_t ptrs[3]; // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR are consecutive
+	uint8_t raw[MAX30102_SAMPLE_LEN_MAX * MAX30102_BYTES_PER_SAMPLE];
+
+	*count = 0;
+	esp_err_t ret = max30102_read_from(this, MAX30102_FIFO_WR_PTR, ptrs, sizeof(ptrs));
+	if(ret != ESP_OK) return ret;
+
+	size_t available = (ptrs[0] - ptrs[2]) & (MAX30102_SAMPLE_LEN_MAX - 1);
+	if(available == 0 && ptrs[1] != 0)
+		available = MAX30102_SAMPLE_LEN_MAX; // FIFO wrapped, it is completely full
+	if(available > max_samples)
+		available = max_samples;
+	if(available == 0)
+		return ESP_OK;
+
+	ret = max30102_read_from(this, MAX30102_FIFO_DATA, raw, available * MAX30102_BYTES_PER_SAMPLE);
+	if(ret != ESP_OK) return ret;
+
+	for(size_t i = 0; i < available; i++){
+		const uint8_t *sample = &raw[i * MAX30102_BYTES_PER_SAMPLE];
+		sensorDataRED[i] = max30102_fifo_word(sample);
+		sensorDataIR[i] = max30102_fifo_word(sample + 3);
+	}
+	*count = available;
+
+	return ESP_OK;
+}
+
+esp_err_t max30102_read_interrupt_status(max30102_t* this, uint8_t *status)
+{
+	return max30102_read_register(this, MAX30102_INTERRUPT_STATUS_1, status);
+}
+
+esp_err_t max30102_start_die_temperature(max30102_t* this)
+{
+	return max30102_write_register(this, MAX30102_DIE_TEMP_CONFIG, MAX30102_DIE_TEMP_EN);
+}
+
+esp_err_t max30102_read_die_temperature(max30102_t* this, float *temperature, bool *ready)
+{
+	uint8_t config, tint, tfrac;
+
+	*ready = false;
+	esp_err_t ret = max30102_read_register(this, MAX30102_DIE_TEMP_CONFIG, &config);
+	if(ret != ESP_OK) return ret;
+	if(config & MAX30102_DIE_TEMP_EN) return ESP_OK; // Still converting
+
+	ret = max30102_read_register(this, MAX30102_DIE_TINT, &tint);
+	if(ret != ESP_OK) return ret;
+	ret = max30102_read_register(this, MAX30102_DIE_TFRAC, &tfrac);
+	if(ret != ESP_OK) return ret;
+
+	// TINT is two's complement, TFRAC holds 1/16 degree steps in its low nibble
+	*temperature = (int8_t)tint + (tfrac & 0x0f) * MAX30102_DIE_TFRAC_INCREMENT;
+	*ready = true;
+	return ESP_OK;
+}
+
 esp_err_t max30102_print_registers(max30102_t* this)
 {
     uint8_t int_status, int_enable, fifo_write, fifo_ovf_cnt, fifo_read;
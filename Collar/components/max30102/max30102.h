@@ -20,6 +20,7 @@
 #include "freertos/task.h"
 #include "esp_err.h"
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <string.h>
@@ -70,7 +71,13 @@
 
 #define MAX30102_LED_IR_PA1 0x0c
 #define MAX30102_LED_RED_PA2 0x0d
+#define MAX30102_PILOT_PA 0x10
 #define REG_PROX_INT_THRESH 0x30
+// Proximity mode: the pilot LED runs on the IR slot until the IR count
+// exceeds the threshold (8 MSBs of the 18 bit ADC, ~256 counts of the 16 bit
+// FIFO samples per step), then PROX_INT fires and SpO2 sampling starts
+#define MAX30102_PILOT_CURRENT MAX30102_LED_CURRENT_7_6MA
+#define MAX30102_PROX_THRESH 0x04 // ~1000 counts, twice the no-contact level
 #define MAX30102_MULTI_LED_CTRL_1 0x11
 #define MAX30102_MULTI_LED_CTRL_SLOT2 4
 #define MAX30102_MULTI_LED_CTRL_SLOT1 0
@@ -219,11 +226,9 @@ typedef struct Message {
   int SpO2;
 } Message;
 extern Message msg;
-void sensor_task_manager(void* arg);
 void i2c_task_0(void* arg);
 void check_ret(esp_err_t ret,uint8_t sensor_data_h);
 void idle_task_0(void* arg);
-void i2c_task_1(void* arg);
 
 
 /**
@@ -240,6 +245,15 @@ esp_err_t max30102_init(max30102_t *this,i2c_port_t i2c_num);
  * @return esp_err_t ESP_OK if successful, error code otherwise
  */
 esp_err_t max30102_shutdown(max30102_t *this);
+/**
+ * @brief Configure the proximity (contact) detection run before sampling.
+ *
+ * @param this Pointer to max30102_t object instance
+ * @param pilot_current Pilot LED current used while waiting for tissue
+ * @param threshold IR level (8 MSBs of the ADC count) that raises PROX_INT
+ * @return esp_err_t ESP_OK if successful, error code otherwise
+ */
+esp_err_t max30102_set_proximity(max30102_t *this, max30102_current_t pilot_current, uint8_t threshold);
 esp_err_t max30102_write_register(max30102_t* this, uint8_t address, uint8_t val);
 esp_err_t max30102_read_register(max30102_t* this, uint8_t address, uint8_t* reg);
 esp_err_t max30102_read_from(max30102_t* this, uint8_t address, uint8_t* reg,uint8_t size);
@@ -253,6 +267,57 @@ void print_array(uint8_t *array,uint16_t size);
  */
 esp_err_t max30102_read_fifo(i2c_port_t i2c_num, uint16_t sensorDataRED[],uint16_t sensorDataIR[]);
 
+/**
+ * @brief Burst read every unread sample currently held in the FIFO.
+ *
+ * @details The number of unread samples is taken from the FIFO write/read
+ * pointers (and the overflow counter when the FIFO has wrapped), then all of
+ * them are read in a single I2C transaction.
+ *
+ * @param sensorDataRED buffer for the red samples.
+ * @param sensorDataIR buffer for the IR samples.
+ * @param max_samples capacity of both buffers.
+ * @param count number of samples actually read.
+ *
+ * @returns status of execution.
+ */
+esp_err_t max30102_read_fifo_burst(max30102_t* this, uint16_t sensorDataRED[], uint16_t sensorDataIR[], size_t max_samples, size_t *count);
+
+/**
+ * @brief Read (and thereby clear) interrupt status register 1.
+ *
+ * @details Reading the status register releases the INT pin.
+ *
+ * @param this is the address of the configuration structure.
+ * @param status is the read MAX30102_INTERRUPT_STATUS_1 value.
+ *
+ * @returns status of execution.
+ */
+esp_err_t max30102_read_interrupt_status(max30102_t* this, uint8_t *status);
+
+/**
+ * @brief Start a single die temperature conversion.
+ *
+ * @details The conversion takes about 29 ms and runs alongside the PPG
+ * sampling; MAX30102_DIE_TEMP_EN clears itself once it is done.
+ *
+ * @param this is the address of the configuration structure.
+ *
+ * @returns status of execution.
+ */
+esp_err_t max30102_start_die_temperature(max30102_t* this);
+
+/**
+ * @brief Read the result of max30102_start_die_temperature() without waiting.
+ *
+ * @param this is the address of the configuration structure.
+ * @param temperature die temperature in degrees Celsius.
+ * @param ready false while the conversion is still running (temperature is not set).
+ *
+ * @returns status of execution.
+ */
+esp_err_t max30102_read_die_temperature(max30102_t* this, float *temperature, bool *ready);
+
 
 /**
  * @brief Sets the sample averaging.
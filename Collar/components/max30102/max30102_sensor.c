@@ -36,6 +36,7 @@
 #include "esp_intr_alloc.h"
 #include "esp_system.h"
 #include "esp_pm.h"
+#include "esp_attr.h"
 
 #define I2C_SDA (GPIO_NUM_21)
 #define I2C_SCL (GPIO_NUM_22)
@@ -47,6 +48,11 @@
 #define GPIO_INPUT_PIN_SEL (1ULL << CONFIG_INT_PIN)
 #define ESP_INTR_FLAG_DEFAULT 0
 static bool sensor_have_finger[2]; // flag for finger presence on sensor
+static TaskHandle_t acquisition_task = NULL; // task notified from the INT pin ISR
+// LED currents (PA register codes) that last gave a good DC level, kept in
+// RTC memory so the next window after deep sleep starts from them
+static RTC_DATA_ATTR uint8_t led_pa_red = MAX30102_LED_CURRENT_11MA;
+static RTC_DATA_ATTR uint8_t led_pa_ir = MAX30102_LED_CURRENT_11MA;
 
 int queueSize = 50;
 
@@ -69,47 +75,36 @@ esp_err_t i2c_master_init(i2c_port_t i2c_port)
 }
 
 // interrupt service routine, called when the INT is low
+// Only wakes the acquisition task; all I2C traffic happens in task context.
 void IRAM_ATTR INT_isr_handler(void *arg)
 {
+    BaseType_t higher_priority_woken = pdFALSE;
 
-    // notify the INT task
-    xTaskCreate(sensor_task_manager, "isr_task_manager", 1024 * 4, (void *)arg, 10, NULL);
+    if (acquisition_task != NULL)
+    {
+        xTaskNotifyFromISR(acquisition_task, MAX30102_NOTIFY_INT, eSetBits, &higher_priority_woken);
+    }
+    if (higher_priority_woken)
+    {
+        portYIELD_FROM_ISR();
+    }
 }
 
-void sensor_task_manager(void *arg)
+uint8_t max30102Sensor_service_interrupt(void)
 {
-    ESP_LOGI("Sensor_TASK_MANAGER", "on core %d\tpin: %d", xPortGetCoreID(), (int)arg);
     uint8_t data = 0x00;
-    i2c_port_t port = (i2c_port_t)arg == I2C_NUM_0;
 
-    esp_err_t ret = max30102_read_register(&max30102, MAX30102_INTERRUPT_STATUS_1, &data);
+    // Reading the status register clears it and releases the INT pin
+    esp_err_t ret = max30102_read_interrupt_status(&max30102, &data);
     if (ret != ESP_OK)
-        return;
-    printf("data: %d\n", data);
-    bool fifo_a_full_int = data >> 7 & 0x01;
+        return 0;
     bool prox_int = data >> 4 & 0x01;
-    bool alc_ovf = data >> 5 & 0x01;
-#ifndef PLOT
-    printf("\tINT Reason: 0x%02x\t", data);
-    if (fifo_a_full_int)
-    {
-        printf("FIFO Almost Full");
-    }
-    if (prox_int)
-    {
-        printf("PROX INT");
-    }
-#endif
     if (prox_int)
     {
         sensor_have_finger[0] = true;
-        // clear buffer
         max30102_write_register(&max30102, MAX30102_INTERRUPT_ENABLE_1, FIFO_A_FULL_EN); // 0b1000 0000 //disable prox interrupt and enable fifo_a_full
     }
-
-    // xTaskCreate(i2c_task_0, "i2c_test_task_0", 1024 * 4, (void* ) 0, 10, NULL);
-    xTaskCreate(i2c_task_1, "i2c_task_1", 1024 * 4, (void *)port, 10, NULL); // 4kB stack size
-    vTaskDelete(NULL);
+    return data;
 }
 
 void i2c_task_0(void *arg)
@@ -128,21 +123,6 @@ void i2c_task_0(void *arg)
     vTaskDelete(NULL);
 }
 
-void i2c_task_1(void *arg)
-{
-    double mean1, mean2;
-#ifndef PLOT
-    printf("Start i2c_task_1!\n");
-#endif
-    int *buffer_pos;
-    uint8_t *raw_pptr_IR, *raw_pptr_RED;
-    raw_pptr_IR = malloc(FIFO_A_FULL);
-    raw_pptr_RED = malloc(FIFO_A_FULL);
-    i2c_port_t port = I2C_NUM_0;
-    uint16_t RAWsensorDataRED[FIFO_A_FULL / 2], RAWsensorDataIR[FIFO_A_FULL / 2];
-    max30102_read_fifo(port, RAWsensorDataRED, RAWsensorDataIR);
-    vTaskDelete(NULL);
-}
 void print_array(uint8_t *array, uint16_t size)
 {
     for (int i = 0; i < size; i++)
@@ -151,11 +131,11 @@ void print_array(uint8_t *array, uint16_t size)
     }
 }
 
-int isr_io_config()
+esp_err_t isr_io_config()
 {
     gpio_config_t io_conf;
-    // disable interrupt
-    io_conf.intr_type = GPIO_INTR_DISABLE;
+    // INT is open drain and active low, interrupt on the falling edge
+    io_conf.intr_type = GPIO_INTR_NEGEDGE;
     // set as input mode
     io_conf.mode = GPIO_MODE_INPUT;
     // bit mask of the pins that you want to set,e.g.GPIO18/19
@@ -167,16 +147,12 @@ int isr_io_config()
     // configure GPIO with the given settings
     gpio_config(&io_conf);
 
-    // enable interrupt on falling (1->0) edge for button pin
-    // gpio_set_intr_type(CONFIG_INT_PIN, GPIO_INTR_NEGEDGE);
-
-    // gpio_pullup_en(CONFIG_INT_PIN);
-    // install gpio isr service
-    // gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+    // install gpio isr service (it may already be installed by another driver)
+    esp_err_t ret = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE)
+        return ret;
     // hook isr handler for specific gpio pin
-
-    // gpio_isr_handler_add(CONFIG_INT_PIN, INT_isr_handler, (void *)CONFIG_INT_PIN);
-    return 0;
+    return gpio_isr_handler_add(CONFIG_INT_PIN, INT_isr_handler, (void *)CONFIG_INT_PIN);
 }
 
 void readRaw(uint16_t sensorDataRED[], uint16_t sensorDataIR[])
@@ -184,6 +160,14 @@ void readRaw(uint16_t sensorDataRED[], uint16_t sensorDataIR[])
     max30102_read_fifo(I2C_NUM_0, sensorDataRED, sensorDataIR);
 }
 
+size_t readFifo(uint16_t sensorDataRED[], uint16_t sensorDataIR[], size_t max_samples)
+{
+    size_t count = 0;
+    if (max30102_read_fifo_burst(&max30102, sensorDataRED, sensorDataIR, max_samples, &count) != ESP_OK)
+        return 0;
+    return count;
+}
+
 void max30102Sensor_init(void)
 {
     // init_uart();
@@ -191,9 +175,64 @@ void max30102Sensor_init(void)
     ESP_ERROR_CHECK(i2c_master_init(I2C_PORT));
     // Init sensor at I2C_NUM_0
     ESP_ERROR_CHECK(max30102_init(&max30102, I2C_PORT));
+    ESP_ERROR_CHECK(max30102_set_led_current(&max30102, led_pa_red, led_pa_ir));
     ESP_ERROR_CHECK(max30102_print_registers(&max30102));
-    isr_io_config();
-    // Start test task
+    sensor_have_finger[0] = false;
+    // The calling task becomes the acquisition task woken by the INT pin
+    acquisition_task = xTaskGetCurrentTaskHandle();
+    max30102Sensor_service_interrupt(); // Clear the power ready flag so INT is released
+    ESP_ERROR_CHECK(isr_io_config());
+}
+
+bool max30102Sensor_probe_contact(uint32_t timeout_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+
+    // PROX_INT is only raised once the pilot LED sees tissue
+    while (!sensor_have_finger[0])
+    {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout)
+        {
+            max30102Sensor_service_interrupt(); // The edge may have been missed
+            break;
+        }
+        // Only consume the INT bit, other notifications stay for the caller
+        xTaskNotifyWait(0, MAX30102_NOTIFY_INT, NULL, timeout - elapsed);
+        max30102Sensor_service_interrupt();
+    }
+    return sensor_have_finger[0];
+}
+
+void max30102Sensor_start_die_temperature(void)
+{
+    max30102_start_die_temperature(&max30102);
+}
+
+bool max30102Sensor_read_die_temperature(float *temperature)
+{
+    bool ready = false;
+    if (max30102_read_die_temperature(&max30102, temperature, &ready) != ESP_OK)
+        return false;
+    return ready;
+}
+
+void max30102Sensor_get_led_current(uint8_t *red_pa, uint8_t *ir_pa)
+{
+    *red_pa = led_pa_red;
+    *ir_pa = led_pa_ir;
+}
+
+esp_err_t max30102Sensor_set_led_current(uint8_t red_pa, uint8_t ir_pa)
+{
+    return max30102_set_led_current(&max30102, red_pa, ir_pa);
+}
+
+void max30102Sensor_save_led_current(uint8_t red_pa, uint8_t ir_pa)
+{
+    led_pa_red = red_pa;
+    led_pa_ir = ir_pa;
 }
 
 /**
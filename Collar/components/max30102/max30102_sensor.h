@@ -1,5 +1,27 @@
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Notification bit set on the acquisition task when the MAX30102 INT pin fires
+#define MAX30102_NOTIFY_INT (1UL << 1)
+// 400 Hz sampling with 4 sample averaging gives one FIFO sample every 10 ms
+#define MAX30102_SAMPLE_PERIOD_US 10000
 
 void max30102Sensor_init();
 void max30102Sensor_shutdown(void);
-void readRaw(uint16_t sensorDataRED[],uint16_t sensorDataIR[]);
\ No newline at end of file
+void readRaw(uint16_t sensorDataRED[],uint16_t sensorDataIR[]);
+// Burst read all unread FIFO samples, returns the number of samples read
+size_t readFifo(uint16_t sensorDataRED[], uint16_t sensorDataIR[], size_t max_samples);
+// Read and clear the interrupt status (releases the INT pin), returns the status byte
+uint8_t max30102Sensor_service_interrupt(void);
+// Wait up to timeout_ms for the proximity interrupt, false when there is no tissue on the sensor
+bool max30102Sensor_probe_contact(uint32_t timeout_ms);
+// Die temperature, started with the PPG window and collected before shutdown
+void max30102Sensor_start_die_temperature(void);
+bool max30102Sensor_read_die_temperature(float *temperature);
+// LED currents (PA register codes) to start the next window from
+void max30102Sensor_get_led_current(uint8_t *red_pa, uint8_t *ir_pa);
+esp_err_t max30102Sensor_set_led_current(uint8_t red_pa, uint8_t ir_pa);
+// Remember the currents across deep sleep
+void max30102Sensor_save_led_current(uint8_t red_pa, uint8_t ir_pa);
@@ -0,0 +1,133 @@
+#include "respRate.h"
+
+//  Averaging length when the heart rate is unknown (1 s)
+#define RESP_SMOOTH_DEFAULT RESP_RATE_HZ
+
+//  Lags (in baseline points) covering RESP_MAX_BRPM..RESP_MIN_BRPM
+#define RESP_MIN_LAG (RESP_RATE_HZ * 60 / RESP_MAX_BRPM)
+#define RESP_MAX_LAG (RESP_RATE_HZ * 60 / RESP_MIN_BRPM)
+
+//  Same harmonic rule as the autocorrelation heart rate engine
+#define RESP_HARMONIC_RATIO 0.85f
+
+void respReset(resp_rate_t *r)
+{
+  r->head = 0;
+  r->count = 0;
+  r->decim_acc = 0;
+  r->decim_count = 0;
+}
+
+void respAddSample(resp_rate_t *r, uint16_t ir)
+{
+  r->decim_acc += ir;
+  if (++r->decim_count < RESP_DECIMATION)
+    return;
+
+  r->baseline[r->head] = r->decim_acc / RESP_DECIMATION;
+  r->head = (r->head + 1) % RESP_LEN;
+  if (r->count < RESP_LEN)
+    r->count++;
+  r->decim_acc = 0;
+  r->decim_count = 0;
+}
+
+//  Lag product of the prepared window, corrected for the shrinking overlap
+static float respLag(const float x[], uint16_t n, uint16_t lag)
+{
+  float sum = 0;
+  for (uint16_t i = 0; i + lag < n; i++)
+    sum += x[i] * x[i + lag];
+  return sum * n / (n - lag);
+}
+
+bool respEstimate(const resp_rate_t *r, float heart_bpm, float *brpm, uint8_t *confidence)
+{
+  *brpm = 0;
+  *confidence = 0;
+
+  if (r->count < RESP_MIN_WINDOW_S * RESP_RATE_HZ)
+    return false;
+
+  // A moving average over exactly one beat period nulls the cardiac pulse
+  // and its harmonics while passing the slower breathing modulation
+  uint16_t smooth = RESP_SMOOTH_DEFAULT;
+  if (heart_bpm > 0)
+    smooth = (uint16_t)(RESP_RATE_HZ * 60.0f / heart_bpm + 0.5f);
+  if (smooth < 1)
+    smooth = 1;
+  if (smooth > RESP_MIN_LAG)
+    smooth = RESP_MIN_LAG;
+
+  // Smoothed baseline in time order, kept off the task stack
+  static float x[RESP_LEN];
+  uint16_t n = r->count - smooth + 1;
+  uint16_t first = (r->head + RESP_LEN - r->count) % RESP_LEN;
+  int32_t sum = 0;
+  for (uint16_t k = 0; k < smooth; k++)
+    sum += r->baseline[(first + k) % RESP_LEN];
+  for (uint16_t i = 0; i < n; i++)
+  {
+    x[i] = (float)sum / smooth;
+    if (i + 1 < n)
+      sum += r->baseline[(first + i + smooth) % RESP_LEN] - r->baseline[(first + i) % RESP_LEN];
+  }
+
+  // Remove the mean and linear drift (collar movement, LED warm up)
+  float mean_t = (n - 1) / 2.0f;
+  float mean_x = 0;
+  for (uint16_t i = 0; i < n; i++)
+    mean_x += x[i];
+  mean_x /= n;
+  float sxy = 0, sxx = 0;
+  for (uint16_t i = 0; i < n; i++)
+  {
+    sxy += (i - mean_t) * (x[i] - mean_x);
+    sxx += (i - mean_t) * (i - mean_t);
+  }
+  float slope = sxx > 0 ? sxy / sxx : 0;
+  for (uint16_t i = 0; i < n; i++)
+    x[i] -= mean_x + slope * (i - mean_t);
+
+  float r0 = respLag(x, n, 0);
+  if (r0 <= 0)
+    return false;
+
+  uint16_t max_lag = RESP_MAX_LAG;
+  if (max_lag + 1 > n / 2)
+    max_lag = n / 2 - 1; // Always compare at least two periods
+
+  float c[RESP_MAX_LAG + 2];
+  for (uint16_t lag = RESP_MIN_LAG - 1; lag <= max_lag + 1; lag++)
+    c[lag] = respLag(x, n, lag) / r0;
+
+  float best = 0;
+  for (uint16_t lag = RESP_MIN_LAG; lag <= max_lag; lag++)
+    if (c[lag] > best)
+      best = c[lag];
+  if (best <= 0)
+    return false;
+
+  // First local maximum that is close enough to the global one
+  uint16_t peak = 0;
+  for (uint16_t lag = RESP_MIN_LAG; lag <= max_lag; lag++)
+  {
+    if (c[lag] >= c[lag - 1] && c[lag] >= c[lag + 1] && c[lag] >= best * RESP_HARMONIC_RATIO)
+    {
+      peak = lag;
+      break;
+    }
+  }
+  if (peak == 0)
+    return false;
+
+  // Parabolic interpolation around the peak for sub-lag resolution
+  float a = c[peak - 1], b = c[peak], d = c[peak + 1];
+  float denom = a - 2 * b + d;
+  float offset = denom < 0 ? 0.5f * (a - d) / denom : 0;
+  float period = (peak + offset) / RESP_RATE_HZ;
+
+  *brpm = 60.0f / period;
+  *confidence = b >= 1.0f ? 100 : (uint8_t)(b * 100);
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef RESP_RATE_H
+#define RESP_RATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//  Respiration rate from the PPG baseline. Breathing modulates the IR DC
+//  level (respiratory induced intensity variation); the 100 Hz IR stream is
+//  reduced to a 10 Hz baseline, the cardiac pulse is averaged out over one
+//  beat period and the breathing period is found by autocorrelation of the
+//  last RESP_WINDOW_S seconds.
+#define RESP_DECIMATION 10
+#define RESP_RATE_HZ (100 / RESP_DECIMATION)
+#define RESP_WINDOW_S 64
+#define RESP_LEN (RESP_RATE_HZ * RESP_WINDOW_S)
+#define RESP_MIN_WINDOW_S 20 // Shortest window that holds two of the slowest breaths
+
+//  Searched respiration range (breaths per minute)
+#define RESP_MIN_BRPM 6
+#define RESP_MAX_BRPM 40
+
+typedef struct
+{
+  uint16_t baseline[RESP_LEN]; // 10 Hz block means of the IR signal
+  uint16_t head;              // next slot to write
+  uint16_t count;             // valid points in baseline
+  int32_t decim_acc;
+  uint8_t decim_count;
+} resp_rate_t;
+
+void respReset(resp_rate_t *r);
+void respAddSample(resp_rate_t *r, uint16_t ir);
+
+//  Estimate the respiration rate of the buffered window. heart_bpm (0 when
+//  unknown) sets the averaging length that removes the cardiac pulse.
+//  confidence is the normalised autocorrelation at the chosen period (0..100).
+//  Returns false when the window is shorter than RESP_MIN_WINDOW_S.
+bool respEstimate(const resp_rate_t *r, float heart_bpm, float *brpm, uint8_t *confidence);
+
+#endif
@@ -0,0 +1,84 @@
+#include "signalQuality.h"
+
+#define SQI_CONTACT_DC 500      // Same no-tissue level the beat detector uses
+#define SQI_CLIP_LEVEL 65000    // Near full scale of the 16 bit FIFO samples
+#define SQI_CLIP_MAX_RATIO 0.05f
+
+//  Perfusion index (%) band considered usable
+#define SQI_PI_MIN 0.05f
+#define SQI_PI_GOOD 0.2f
+#define SQI_PI_MAX 20.0f
+
+//  Heart rate engine confidence below this is reported as irregular
+#define SQI_CONFIDENCE_MIN 30
+
+void sqiReset(signal_quality_t *q)
+{
+  q->samples = 0;
+  q->clipped = 0;
+}
+
+void sqiAddSamples(signal_quality_t *q, const uint16_t ir[], size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    if (ir[i] >= SQI_CLIP_LEVEL)
+      q->clipped++;
+  }
+  q->samples += count;
+}
+
+uint8_t sqiEvaluate(const signal_quality_t *q, const ppg_channel_t *ir, int bpm, uint8_t hr_confidence,
+                    uint8_t *flags, float *perfusion)
+{
+  *flags = 0;
+  *perfusion = 0;
+
+  float dc = ppgChannelDC(ir);
+  if (q->samples == 0 || dc < SQI_CONTACT_DC)
+  {
+    *flags |= SQI_FLAG_NO_CONTACT;
+    return 0;
+  }
+
+  float clip_ratio = (float)q->clipped / q->samples;
+  if (clip_ratio > SQI_CLIP_MAX_RATIO)
+  {
+    *flags |= SQI_FLAG_CLIPPED;
+    return 0;
+  }
+
+  // Perfusion component
+  *perfusion = 100.0f * ppgChannelACrms(ir) / dc;
+  float pi_score;
+  if (*perfusion < SQI_PI_MIN)
+  {
+    *flags |= SQI_FLAG_NO_PULSE;
+    pi_score = 0;
+  }
+  else if (*perfusion > SQI_PI_MAX)
+  {
+    // More AC than any pulse gives, movement of the sensor on the skin
+    *flags |= SQI_FLAG_IRREGULAR;
+    pi_score = 0;
+  }
+  else if (*perfusion < SQI_PI_GOOD)
+    pi_score = (*perfusion - SQI_PI_MIN) / (SQI_PI_GOOD - SQI_PI_MIN);
+  else
+    pi_score = 1;
+
+  // Regularity component
+  float regularity_score = hr_confidence / 100.0f;
+  if (bpm <= 0)
+  {
+    *flags |= SQI_FLAG_FEW_BEATS;
+    regularity_score = 0;
+  }
+  else if (hr_confidence < SQI_CONFIDENCE_MIN)
+    *flags |= SQI_FLAG_IRREGULAR;
+
+  // Occasional clipping only costs a little
+  float clip_score = 1.0f - clip_ratio / SQI_CLIP_MAX_RATIO * 0.5f;
+
+  return (uint8_t)(100.0f * pi_score * regularity_score * clip_score + 0.5f);
+}
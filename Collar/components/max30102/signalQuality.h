@@ -0,0 +1,37 @@
+#ifndef SIGNAL_QUALITY_H
+#define SIGNAL_QUALITY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "heartRate.h"
+
+#define SQI_MIN_FOR_HR 50 // Heart rate below this quality is not reported
+
+// Reasons that pulled the quality index down
+#define SQI_FLAG_NO_CONTACT (1 << 0) // DC too low, sensor is off the skin
+#define SQI_FLAG_CLIPPED    (1 << 1) // Samples hit the ADC full scale
+#define SQI_FLAG_NO_PULSE   (1 << 2) // Good contact but no pulsatile component
+#define SQI_FLAG_IRREGULAR  (1 << 3) // Heart rate engine has low confidence
+#define SQI_FLAG_FEW_BEATS  (1 << 4) // Heart rate engine has no estimate yet
+#define SQI_FLAG_SETTLING   (1 << 5) // Window ended while the LEDs settled after a current change
+#define SQI_FLAG_LOW_QUALITY (1 << 6) // Index below SQI_MIN_FOR_HR, the heart rate was withheld
+
+// Per window signal quality accumulator
+typedef struct
+{
+  uint32_t samples;
+  uint32_t clipped;
+} signal_quality_t;
+
+void sqiReset(signal_quality_t *q);
+void sqiAddSamples(signal_quality_t *q, const uint16_t ir[], size_t count);
+
+//  Signal quality index 0..100 for the window so far, built from the perfusion
+//  index of the IR channel, the heart rate engine confidence (beat regularity
+//  or autocorrelation strength) and clipping.
+//  flags receives the SQI_FLAG_* reasons, perfusion the IR AC/DC in percent.
+uint8_t sqiEvaluate(const signal_quality_t *q, const ppg_channel_t *ir, int bpm, uint8_t hr_confidence,
+                    uint8_t *flags, float *perfusion);
+
+#endif
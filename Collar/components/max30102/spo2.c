@@ -0,0 +1,52 @@
+#include "spo2.h"
+
+//  Acceptable window for the ratio of ratios R = (ACred/DCred) / (ACir/DCir)
+#define SPO2_R_MIN 0.3f
+#define SPO2_R_MAX 1.5f
+
+//  Perfusion (AC/DC of IR) outside this range is motion or no pulse at all
+#define SPO2_PI_MIN 0.0005f
+#define SPO2_PI_MAX 0.2f
+
+void spo2Reset(spo2_t *s)
+{
+  ppgChannelReset(&s->red);
+  ppgChannelReset(&s->ir);
+}
+
+//  Feed the same batch of samples the beat detector sees
+void spo2AddSamples(spo2_t *s, const uint16_t red[], const uint16_t ir[], size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    ppgChannelAdd(&s->red, red[i]);
+    ppgChannelAdd(&s->ir, ir[i]);
+  }
+}
+
+bool spo2Estimate(const spo2_t *s, uint8_t *spo2)
+{
+  *spo2 = 0;
+
+  float dc_red = ppgChannelDC(&s->red);
+  float dc_ir = ppgChannelDC(&s->ir);
+  if (s->ir.count < SPO2_MIN_SAMPLES || dc_red < SPO2_MIN_DC || dc_ir < SPO2_MIN_DC)
+    return false;
+
+  float pi_red = ppgChannelACrms(&s->red) / dc_red;
+  float pi_ir = ppgChannelACrms(&s->ir) / dc_ir;
+  if (pi_ir < SPO2_PI_MIN || pi_ir > SPO2_PI_MAX)
+    return false;
+
+  float r = pi_red / pi_ir;
+
+  //  Standard empirical linear calibration
+  float value = 110.0f - 25.0f * r;
+  if (value > 100.0f)
+    value = 100.0f;
+  if (value < 0.0f)
+    value = 0.0f;
+  *spo2 = (uint8_t)(value + 0.5f);
+
+  return r >= SPO2_R_MIN && r <= SPO2_R_MAX;
+}
@@ -0,0 +1,26 @@
+#ifndef SPO2_H
+#define SPO2_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "heartRate.h"
+
+#define SPO2_MIN_SAMPLES 300 // 3 s of 100 Hz samples before an estimate is trusted
+#define SPO2_MIN_DC 500      // Below this DC level there is no tissue on the sensor
+
+// SpO2 accumulator for one measurement window
+typedef struct
+{
+  ppg_channel_t red;
+  ppg_channel_t ir;
+} spo2_t;
+
+void spo2Reset(spo2_t *s);
+void spo2AddSamples(spo2_t *s, const uint16_t red[], const uint16_t ir[], size_t count);
+
+//  Ratio-of-ratios SpO2 over everything accumulated so far.
+//  Returns true when the estimate passes the quality checks.
+bool spo2Estimate(const spo2_t *s, uint8_t *spo2);
+
+#endif
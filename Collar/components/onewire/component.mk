@@ -5,3 +5,7 @@ COMPONENT_DEPENDS = esp8266 freertos esp_idf_lib_helpers
 else
 COMPONENT_DEPENDS = driver freertos esp_idf_lib_helpers
 endif
+
+ifndef CONFIG_ONEWIRE_BACKEND_RMT
+COMPONENT_OBJEXCLUDE := onewire_rmt.o
+endif
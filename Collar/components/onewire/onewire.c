@@ -60,6 +60,10 @@
 #define ONEWIRE_SKIP_ROM   0xcc
 #define ONEWIRE_SEARCH     0xf0
 
+// The bus timing below is bit-banged, CONFIG_ONEWIRE_BACKEND_RMT replaces it
+// with onewire_rmt.c
+#ifndef CONFIG_ONEWIRE_BACKEND_RMT
+
 #if HELPER_TARGET_IS_ESP8266
 #define PORT_ENTER_CRITICAL portENTER_CRITICAL()
 #define PORT_EXIT_CRITICAL portEXIT_CRITICAL()
@@ -194,6 +198,26 @@ bool onewire_write_bytes(gpio_num_t pin, const uint8_t *buf, size_t count)
     return true;
 }
 
+bool onewire_write_power(gpio_num_t pin, uint8_t v)
+{
+    for (uint8_t bitMask = 0x01; bitMask != 0x80; bitMask <<= 1)
+        if (!_onewire_write_bit(pin, (bitMask & v)))
+            return false;
+
+    // Power must be applied within 10us after the last bit, keep the two
+    // together (the critical section nests)
+    PORT_ENTER_CRITICAL;
+    bool r = _onewire_write_bit(pin, v & 0x80);
+    if (r)
+    {
+        setup_pin(pin, false);
+        gpio_set_level(pin, 1);
+    }
+    PORT_EXIT_CRITICAL;
+
+    return r;
+}
+
 // Read a byte
 //
 int onewire_read(gpio_num_t pin)
@@ -211,6 +235,16 @@ int onewire_read(gpio_num_t pin)
     return r;
 }
 
+int onewire_read_bit(gpio_num_t pin)
+{
+    return _onewire_read_bit(pin);
+}
+
+bool onewire_write_bit(gpio_num_t pin, bool v)
+{
+    return _onewire_write_bit(pin, v);
+}
+
 bool onewire_read_bytes(gpio_num_t pin, uint8_t *buf, size_t count)
 {
     size_t i;
@@ -226,6 +260,8 @@ bool onewire_read_bytes(gpio_num_t pin, uint8_t *buf, size_t count)
     return true;
 }
 
+#endif /* CONFIG_ONEWIRE_BACKEND_RMT */
+
 bool onewire_select(gpio_num_t pin, onewire_addr_t addr)
 {
     uint8_t i;
@@ -248,6 +284,8 @@ bool onewire_skip_rom(gpio_num_t pin)
     return onewire_write(pin, ONEWIRE_SKIP_ROM);
 }
 
+#ifndef CONFIG_ONEWIRE_BACKEND_RMT
+
 bool onewire_power(gpio_num_t pin)
 {
     // Make sure the bus is not being held low before driving it high, or we
@@ -266,6 +304,8 @@ void onewire_depower(gpio_num_t pin)
     setup_pin(pin, true);
 }
 
+#endif /* CONFIG_ONEWIRE_BACKEND_RMT */
+
 void onewire_search_start(onewire_search_t *search)
 {
     // reset the search state
@@ -335,8 +375,8 @@ onewire_addr_t onewire_search_next(onewire_search_t *search, gpio_num_t pin)
         do
         {
             // read a bit and its complement
-            id_bit = _onewire_read_bit(pin);
-            cmp_id_bit = _onewire_read_bit(pin);
+            id_bit = onewire_read_bit(pin);
+            cmp_id_bit = onewire_read_bit(pin);
 
             if ((id_bit == 1) && (cmp_id_bit == 1))
                 break;
@@ -368,7 +408,7 @@ onewire_addr_t onewire_search_next(onewire_search_t *search, gpio_num_t pin)
                     search->rom_no[rom_byte_number] &= ~rom_byte_mask;
 
                 // serial number search direction write bit
-                _onewire_write_bit(pin, search_direction);
+                onewire_write_bit(pin, search_direction);
 
                 // increment the byte counter id_bit_number
                 // and shift the mask rom_byte_mask
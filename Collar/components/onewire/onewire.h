@@ -49,6 +49,9 @@
  * under an MIT license with an additional clause (prohibiting inappropriate use
  * of the Dallas Semiconductor name).  See the accompanying LICENSE file for
  * details.
+ *
+ * With CONFIG_ONEWIRE_BACKEND_RMT the slots are generated and sampled by the
+ * ESP32 RMT peripheral instead (onewire_rmt.c), the API is the same.
  */
 #ifndef __ONEWIRE_H__
 #define __ONEWIRE_H__
@@ -123,8 +126,7 @@ bool onewire_skip_rom(gpio_num_t pin);
  *
  * The writing code uses open-drain mode and expects the pullup resistor to
  * pull the line high when not driven low. If you need strong power after the
- * write (e.g. DS18B20 in parasite power mode) then call ::onewire_power()
- * after this is complete to actively drive the line high.
+ * write (e.g. DS18B20 in parasite power mode) use ::onewire_write_power().
  *
  * @param pin   The GPIO pin connected to the 1-Wire bus.
  * @param v     The byte value to write
@@ -133,6 +135,21 @@ bool onewire_skip_rom(gpio_num_t pin);
  */
 bool onewire_write(gpio_num_t pin, uint8_t v);
 
+/**
+ * @brief Write a byte and actively drive the bus high right after it.
+ *
+ * For commands after which parasitically-powered devices need the strong
+ * pull-up within 10us (e.g. DS18B20 CONVERT_T and COPY SCRATCHPAD). The bus
+ * stays powered until ::onewire_depower() or the next ::onewire_reset().
+ * Call it with interrupts enabled.
+ *
+ * @param pin   The GPIO pin connected to the 1-Wire bus.
+ * @param v     The byte value to write
+ *
+ * @return `true` if successful, `false` on error.
+ */
+bool onewire_write_power(gpio_num_t pin, uint8_t v);
+
 /**
  * @brief Write multiple bytes on the 1-Wire bus.
  *
@@ -155,6 +172,28 @@ bool onewire_write_bytes(gpio_num_t pin, const uint8_t *buf, size_t count);
  */
 int onewire_read(gpio_num_t pin);
 
+/**
+ * @brief Issue a single read time slot.
+ *
+ * After a "convert T" command a DS18B20 answers read slots with 0 while the
+ * conversion is running and with 1 once it is done.
+ *
+ * @param pin    The GPIO pin connected to the 1-Wire bus.
+ *
+ * @return the bit read (0 or 1), negative value on error.
+ */
+int onewire_read_bit(gpio_num_t pin);
+
+/**
+ * @brief Issue a single write time slot.
+ *
+ * @param pin    The GPIO pin connected to the 1-Wire bus.
+ * @param v      The bit value to write
+ *
+ * @return `true` if successful, `false` on error.
+ */
+bool onewire_write_bit(gpio_num_t pin, bool v);
+
 /**
  * @brief Read multiple bytes from a 1-Wire device.
  *
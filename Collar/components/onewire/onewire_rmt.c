@@ -0,0 +1,317 @@
+/**
+ * @file onewire_rmt.c
+ *
+ * 1-Wire bus timing generated by the ESP32 RMT peripheral.
+ *
+ * Replaces the bit-banged low level routines of onewire.c when
+ * CONFIG_ONEWIRE_BACKEND_RMT is selected. One RMT channel transmits the
+ * reset pulse and the time slots, a second channel on the same open-drain
+ * pin records the bus so the presence pulse and the read bits are decoded
+ * from the captured levels. The calling task blocks on the driver while a
+ * byte is on the wire, interrupts stay enabled and the other core is not
+ * held up by a spinlock.
+ *
+ * ROM commands, search and CRC stay in onewire.c and run on top of these.
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/ringbuf.h>
+#include <ets_sys.h>
+#include <esp_log.h>
+#include <driver/rmt.h>
+#include <hal/gpio_ll.h>
+#include <soc/gpio_struct.h>
+#include "onewire.h"
+
+#define OW_TX_CHANNEL CONFIG_ONEWIRE_RMT_TX_CHANNEL
+#define OW_RX_CHANNEL CONFIG_ONEWIRE_RMT_RX_CHANNEL
+
+#define OW_CLK_DIV     80  // 1 us ticks from the 80 MHz APB clock
+#define OW_RESET_LOW   480 // Reset pulse
+#define OW_RESET_IDLE  (OW_RESET_LOW + 60) // Longer than any level of the reset and presence sequence
+#define OW_SLOT        70  // Write and read slot including recovery
+#define OW_LOW_1       6   // Low time of a write 1 and of a read slot
+#define OW_LOW_0       60  // Low time of a write 0
+#define OW_SAMPLE      15  // A read slot held low longer than this is a 0
+#define OW_SLOT_IDLE   80  // Bus high this long after the last slot ends a capture
+#define OW_RX_FILTER   30  // APB cycles (~0.4 us), shorter glitches are ignored
+#define OW_RX_BUF_SIZE 512
+#define OW_TIMEOUT_MS  20
+
+static const char *TAG = "onewire_rmt";
+
+static gpio_num_t bus_pin = GPIO_NUM_NC;
+static RingbufHandle_t rx_buf = NULL;
+
+// Waits up to `max_wait` microseconds for the bus to be released
+static bool wait_for_bus(gpio_num_t pin, int max_wait)
+{
+    for (int i = 0; i < ((max_wait + 4) / 5) && !gpio_get_level(pin); i++)
+        ets_delay_us(5);
+    return gpio_get_level(pin);
+}
+
+static rmt_item32_t slot_item(uint32_t low, uint32_t high)
+{
+    rmt_item32_t item;
+    item.level0 = 0;
+    item.duration0 = low;
+    item.level1 = 1;
+    item.duration1 = high;
+    return item;
+}
+
+static esp_err_t install(gpio_num_t pin)
+{
+    rmt_config_t rx = {
+        .rmt_mode = RMT_MODE_RX,
+        .channel = OW_RX_CHANNEL,
+        .gpio_num = pin,
+        .clk_div = OW_CLK_DIV,
+        .mem_block_num = 1,
+        .rx_config = {
+            .filter_en = true,
+            .filter_ticks_thresh = OW_RX_FILTER,
+            .idle_threshold = OW_SLOT_IDLE,
+        },
+    };
+    rmt_config_t tx = {
+        .rmt_mode = RMT_MODE_TX,
+        .channel = OW_TX_CHANNEL,
+        .gpio_num = pin,
+        .clk_div = OW_CLK_DIV,
+        .mem_block_num = 1,
+        .tx_config = {
+            .idle_level = RMT_IDLE_LEVEL_HIGH,
+            .idle_output_en = true,
+        },
+    };
+
+    // RX first, routing its input disconnects the pin output
+    esp_err_t res = rmt_config(&rx);
+    if (res == ESP_OK)
+        res = rmt_driver_install(OW_RX_CHANNEL, OW_RX_BUF_SIZE, 0);
+    if (res == ESP_OK)
+        res = rmt_get_ringbuf_handle(OW_RX_CHANNEL, &rx_buf);
+    if (res == ESP_OK)
+        res = rmt_config(&tx);
+    if (res == ESP_OK)
+        res = rmt_driver_install(OW_TX_CHANNEL, 0, 0);
+    return res;
+}
+
+// Routes both channels to `pin`, installing the driver on first use
+static bool attach(gpio_num_t pin)
+{
+    if (pin == bus_pin)
+        return true;
+
+    esp_err_t res;
+    if (bus_pin == GPIO_NUM_NC)
+    {
+        res = install(pin);
+    }
+    else
+    {
+        gpio_reset_pin(bus_pin);
+        res = rmt_set_gpio(OW_RX_CHANNEL, RMT_MODE_RX, pin, false);
+        if (res == ESP_OK)
+            res = rmt_set_gpio(OW_TX_CHANNEL, RMT_MODE_TX, pin, false);
+    }
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "RMT setup on GPIO %d failed: %s", pin, esp_err_to_name(res));
+        return false;
+    }
+
+    // The TX routing turned the input off, RX needs it. Open drain lets the
+    // devices pull the bus low against the idle level.
+    gpio_ll_input_enable(&GPIO, pin);
+    gpio_ll_od_enable(&GPIO, pin);
+    gpio_set_pull_mode(pin, GPIO_PULLUP_ONLY);
+    bus_pin = pin;
+    return true;
+}
+
+// Drops anything left in the capture buffer from an earlier transfer
+static void flush_rx(void)
+{
+    size_t size;
+    void *items;
+    while ((items = xRingbufferReceive(rx_buf, &size, 0)) != NULL)
+        vRingbufferReturnItem(rx_buf, items);
+}
+
+// Sends the items while capturing the bus, `rx` must be returned to rx_buf
+static rmt_item32_t *transfer_capture(const rmt_item32_t *items, size_t count, size_t *rx_count)
+{
+    flush_rx();
+    rmt_rx_start(OW_RX_CHANNEL, true);
+    esp_err_t res = rmt_write_items(OW_TX_CHANNEL, items, count, true);
+
+    size_t size = 0;
+    rmt_item32_t *rx = NULL;
+    if (res == ESP_OK)
+        rx = xRingbufferReceive(rx_buf, &size, pdMS_TO_TICKS(OW_TIMEOUT_MS));
+    rmt_rx_stop(OW_RX_CHANNEL);
+
+    *rx_count = size / sizeof(rmt_item32_t);
+    return rx;
+}
+
+// Sends write slots
+static bool transfer(const rmt_item32_t *items, size_t count)
+{
+    if (rmt_write_items(OW_TX_CHANNEL, items, count, false) != ESP_OK)
+        return false;
+    return rmt_wait_tx_done(OW_TX_CHANNEL, pdMS_TO_TICKS(OW_TIMEOUT_MS)) == ESP_OK;
+}
+
+static void byte_items(rmt_item32_t *items, uint8_t v)
+{
+    for (int i = 0; i < 8; i++, v >>= 1)
+        items[i] = (v & 0x01) ? slot_item(OW_LOW_1, OW_SLOT - OW_LOW_1) : slot_item(OW_LOW_0, OW_SLOT - OW_LOW_0);
+}
+
+bool onewire_reset(gpio_num_t pin)
+{
+    if (!attach(pin))
+        return false;
+
+    onewire_depower(pin);
+    if (!wait_for_bus(pin, 250))
+        return false;
+
+    // Capture the whole reset and presence sequence in one go
+    rmt_set_rx_idle_thresh(OW_RX_CHANNEL, OW_RESET_IDLE);
+    rmt_item32_t item = slot_item(OW_RESET_LOW, 0);
+    size_t n;
+    rmt_item32_t *rx = transfer_capture(&item, 1, &n);
+    rmt_set_rx_idle_thresh(OW_RX_CHANNEL, OW_SLOT_IDLE);
+    if (rx == NULL)
+        return false;
+
+    // Our reset low, the bus released, then a device pulling it low again
+    bool present = n >= 2 &&
+                   rx[0].level0 == 0 && rx[0].duration0 >= OW_RESET_LOW - 2 &&
+                   rx[0].level1 == 1 && rx[0].duration1 > 0 &&
+                   rx[1].level0 == 0;
+    vRingbufferReturnItem(rx_buf, rx);
+
+    return present && wait_for_bus(pin, 410);
+}
+
+bool onewire_write_bit(gpio_num_t pin, bool v)
+{
+    if (!attach(pin) || !wait_for_bus(pin, 10))
+        return false;
+
+    rmt_item32_t item = v ? slot_item(OW_LOW_1, OW_SLOT - OW_LOW_1) : slot_item(OW_LOW_0, OW_SLOT - OW_LOW_0);
+    return transfer(&item, 1);
+}
+
+bool onewire_write(gpio_num_t pin, uint8_t v)
+{
+    if (!attach(pin) || !wait_for_bus(pin, 10))
+        return false;
+
+    rmt_item32_t items[8];
+    byte_items(items, v);
+    return transfer(items, 8);
+}
+
+bool onewire_write_power(gpio_num_t pin, uint8_t v)
+{
+    if (!attach(pin) || !wait_for_bus(pin, 10))
+        return false;
+
+    // Only the master drives the bus during write slots, so the byte can go
+    // out push-pull. The TX channel idles high, the strong pull-up is there
+    // the moment the last slot ends without any timing on the CPU side.
+    rmt_item32_t items[8];
+    byte_items(items, v);
+    gpio_ll_od_disable(&GPIO, pin);
+    if (!transfer(items, 8))
+    {
+        onewire_depower(pin);
+        return false;
+    }
+    return true;
+}
+
+bool onewire_write_bytes(gpio_num_t pin, const uint8_t *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (!onewire_write(pin, buf[i]))
+            return false;
+
+    return true;
+}
+
+// Issues `count` read slots, returns the bits LSB first or -1 on error
+static int read_slots(gpio_num_t pin, int count)
+{
+    if (!attach(pin) || !wait_for_bus(pin, 10))
+        return -1;
+
+    rmt_item32_t items[8];
+    for (int i = 0; i < count; i++)
+        items[i] = slot_item(OW_LOW_1, OW_SLOT - OW_LOW_1);
+
+    size_t n;
+    rmt_item32_t *rx = transfer_capture(items, count, &n);
+    if (rx == NULL)
+        return -1;
+
+    // One low period per slot, longer than the sample point when a device held it
+    int r = -1;
+    if (n >= (size_t)count)
+    {
+        r = 0;
+        for (int i = 0; i < count; i++)
+            if (rx[i].level0 == 0 && rx[i].duration0 <= OW_SAMPLE)
+                r |= 1 << i;
+    }
+    vRingbufferReturnItem(rx_buf, rx);
+    return r;
+}
+
+int onewire_read(gpio_num_t pin)
+{
+    return read_slots(pin, 8);
+}
+
+int onewire_read_bit(gpio_num_t pin)
+{
+    return read_slots(pin, 1);
+}
+
+bool onewire_read_bytes(gpio_num_t pin, uint8_t *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int b = onewire_read(pin);
+        if (b < 0)
+            return false;
+        buf[i] = b;
+    }
+    return true;
+}
+
+bool onewire_power(gpio_num_t pin)
+{
+    // Make sure the bus is not being held low before driving it high
+    if (!attach(pin) || !wait_for_bus(pin, 10))
+        return false;
+
+    // The TX channel idles high, without open drain it drives the bus
+    gpio_ll_od_disable(&GPIO, pin);
+    return true;
+}
+
+void onewire_depower(gpio_num_t pin)
+{
+    if (attach(pin))
+        gpio_ll_od_enable(&GPIO, pin);
+}
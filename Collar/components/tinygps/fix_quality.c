@@ -0,0 +1,78 @@
+#include "fix_quality.h"
+
+// HDOP upper bounds (100ths) of the FIX_HDOP_* classes
+static const uint32_t hdop_class_max[] = { 100, 200, 500, 1000, 2000 };
+
+static bool hdop_known(const gps_fix_t *fix)
+{
+  return fix->hdop != GPS_INVALID_HDOP;
+}
+
+static bool satellites_known(const gps_fix_t *fix)
+{
+  return fix->satellites != GPS_INVALID_SATELLITES;
+}
+
+bool fix_meets_criteria(const gps_fix_t *fix, const fix_criteria_t *criteria)
+{
+  if (fix->fix_age == GPS_INVALID_AGE || fix->fix_age > criteria->max_age)
+    return false;
+
+  // An RMC-only fix carries neither, it cannot prove it is good enough
+  if (criteria->min_satellites > 0 &&
+      (!satellites_known(fix) || fix->satellites < criteria->min_satellites))
+    return false;
+  // NMEA has no accuracy estimate, HDOP stands in for it there. A UBX fix
+  // is judged on its accuracy estimate alone.
+  if (fix->h_acc > 0)
+    return criteria->max_h_acc == 0 || fix->h_acc <= criteria->max_h_acc;
+  if (criteria->max_hdop > 0 && (!hdop_known(fix) || fix->hdop > criteria->max_hdop))
+    return false;
+
+  return true;
+}
+
+bool fix_better(const gps_fix_t *a, const gps_fix_t *b)
+{
+  if (a->h_acc > 0 && b->h_acc > 0 && a->h_acc != b->h_acc)
+    return a->h_acc < b->h_acc;
+
+  if (hdop_known(a) != hdop_known(b))
+    return hdop_known(a);
+  if (hdop_known(a) && a->hdop != b->hdop)
+    return a->hdop < b->hdop;
+
+  if (satellites_known(a) != satellites_known(b))
+    return satellites_known(a);
+  if (satellites_known(a) && a->satellites != b->satellites)
+    return a->satellites > b->satellites;
+
+  // Same geometry, the newer one
+  return a->fix_age < b->fix_age;
+}
+
+uint8_t fix_quality_byte(const gps_fix_t *fix, bool accepted)
+{
+  if (fix == NULL)
+    return FIX_QUALITY_NONE;
+
+  uint8_t hdop_class = FIX_HDOP_UNKNOWN;
+  if (hdop_known(fix))
+  {
+    hdop_class = FIX_HDOP_POOR;
+    for (int i = 0; i < (int)(sizeof(hdop_class_max) / sizeof(hdop_class_max[0])); i++)
+    {
+      if (fix->hdop <= hdop_class_max[i])
+      {
+        hdop_class = FIX_HDOP_1 + i;
+        break;
+      }
+    }
+  }
+
+  uint8_t sats = satellites_known(fix) ? fix->satellites : 0;
+  if (sats > FIX_QUALITY_SATS_MASK)
+    sats = FIX_QUALITY_SATS_MASK;
+
+  return (accepted ? FIX_QUALITY_ACCEPTED : 0) | (hdop_class << FIX_QUALITY_HDOP_SHIFT) | sats;
+}
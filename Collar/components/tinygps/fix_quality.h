@@ -0,0 +1,45 @@
+/*
+Acceptance criteria for a position fix and the fix-quality byte sent in
+the uplink. Works on gps_fix_t so NMEA and UBX fixes are judged alike.
+*/
+#ifndef fix_quality_h
+#define fix_quality_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "tinygps.h"
+
+// Fix-quality byte: 0 when there was no fix at all, otherwise
+//   bit 7    the fix met the acceptance criteria
+//   bits 4-6 HDOP class, see FIX_HDOP_*
+//   bits 0-3 satellites used, 15 means 15 or more
+#define FIX_QUALITY_NONE 0
+#define FIX_QUALITY_ACCEPTED 0x80
+#define FIX_QUALITY_HDOP_SHIFT 4
+#define FIX_QUALITY_SATS_MASK 0x0F
+
+enum {
+  FIX_HDOP_1 = 1,       // <= 1
+  FIX_HDOP_2 = 2,       // <= 2
+  FIX_HDOP_5 = 3,       // <= 5
+  FIX_HDOP_10 = 4,      // <= 10
+  FIX_HDOP_20 = 5,      // <= 20
+  FIX_HDOP_POOR = 6,    // > 20
+  FIX_HDOP_UNKNOWN = 7
+};
+
+typedef struct {
+  uint8_t min_satellites;
+  uint32_t max_hdop;     // 100ths, 0 = not checked, only for fixes without an accuracy estimate
+  uint32_t max_h_acc;    // mm, 0 = not checked, only UBX fixes report it
+  uint32_t max_age;      // ms
+} fix_criteria_t;
+
+// true when the fix is good enough to report as the animal's position
+bool fix_meets_criteria(const gps_fix_t *fix, const fix_criteria_t *criteria);
+// true when `a` is a better position than `b`
+bool fix_better(const gps_fix_t *a, const gps_fix_t *b);
+// the uplink byte for `fix`, NULL for no fix
+uint8_t fix_quality_byte(const gps_fix_t *fix, bool accepted);
+
+#endif
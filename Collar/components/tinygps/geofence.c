@@ -0,0 +1,122 @@
+#include <math.h>
+#include "geofence.h"
+
+#define GEO_EARTH_RADIUS 6371000.0 // m, the backend's sphere
+#define GEO_M_PER_UNIT 0.0111194927f // m per 1e-7 degrees of latitude
+#define GEO_FULL_TURN 3600000000LL // 360 degrees in 1e-7
+// The flat distance is within a fraction of a percent of the great circle
+// over zone sized distances, closer than this to a boundary it is not trusted
+#define GEO_FAST_MARGIN 0.005f
+#define GEO_FAST_MARGIN_M 2.0f
+
+static int32_t get_i32(const uint8_t *p)
+{
+  return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+bool geofence_parse(const uint8_t *payload, size_t len, geofence_table_t *t)
+{
+  if (len < GEOFENCE_HEADER_SIZE)
+    return false;
+  uint32_t id = (uint32_t)get_i32(payload);
+  uint8_t count = payload[6];
+  if (id == 0 || count > GEOFENCE_MAX ||
+      len < GEOFENCE_HEADER_SIZE + (size_t)count * GEOFENCE_ENTRY_SIZE)
+    return false;
+
+  const uint8_t *p = payload + GEOFENCE_HEADER_SIZE;
+  for (uint8_t i = 0; i < count; i++, p += GEOFENCE_ENTRY_SIZE)
+  {
+    geofence_t *z = &t->zone[i];
+    z->lat = get_i32(p);
+    z->lon = get_i32(p + 4);
+    z->radius = get_u16(p + 8);
+    z->type = p[10];
+    if (z->type > GEOFENCE_ZONE_DANGER || z->lat < -900000000 || z->lat > 900000000)
+      return false;
+    z->m_per_lon = GEO_M_PER_UNIT * (float)cos(z->lat * 1e-7 * M_PI / 180.0);
+  }
+  t->id = id;
+  t->buffer_m = get_u16(payload + 4);
+  t->count = count;
+  return true;
+}
+
+static double haversine(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+  double to_rad = 1e-7 * M_PI / 180.0;
+  double dlat = ((int64_t)lat2 - lat1) * to_rad;
+  double dlon = ((int64_t)lon2 - lon1) * to_rad;
+  double a = sin(dlat / 2) * sin(dlat / 2) +
+             cos(lat1 * to_rad) * cos(lat2 * to_rad) * sin(dlon / 2) * sin(dlon / 2);
+  return GEO_EARTH_RADIUS * 2 * atan2(sqrt(a), sqrt(1 - a));
+}
+
+// true when lat/lon is no further than `limit` meters from the zone centre
+static bool within(const geofence_t *z, int32_t lat, int32_t lon, int32_t limit)
+{
+  if (limit < 0)
+    return false;
+
+  int64_t dlon = (int64_t)lon - z->lon;
+  // Shortest way round across the antimeridian
+  if (dlon > GEO_FULL_TURN / 2)
+    dlon -= GEO_FULL_TURN;
+  else if (dlon < -GEO_FULL_TURN / 2)
+    dlon += GEO_FULL_TURN;
+
+  float north = (float)((int64_t)lat - z->lat) * GEO_M_PER_UNIT;
+  float east = (float)dlon * z->m_per_lon;
+  float d2 = north * north + east * east;
+  float margin = limit * GEO_FAST_MARGIN + GEO_FAST_MARGIN_M;
+  float inner = limit - margin;
+  float outer = limit + margin;
+  if (inner > 0 && d2 <= inner * inner)
+    return true;
+  if (d2 > outer * outer)
+    return false;
+  return haversine(lat, lon, z->lat, z->lon) <= limit;
+}
+
+geofence_status_t geofence_check(const geofence_table_t *t, int32_t lat, int32_t lon)
+{
+  if (t->id == 0)
+    return GEOFENCE_UNKNOWN;
+  if (t->count == 0)
+    return GEOFENCE_SAFE;
+
+  bool in_safe = false;
+  bool in_warning = false;
+
+  // Danger zones first, inside one settles it
+  for (uint8_t i = 0; i < t->count; i++)
+  {
+    const geofence_t *z = &t->zone[i];
+    if (z->type != GEOFENCE_ZONE_DANGER)
+      continue;
+    if (within(z, lat, lon, z->radius))
+      return GEOFENCE_DANGER;
+    if (!in_warning && within(z, lat, lon, (int32_t)z->radius + t->buffer_m))
+      in_warning = true;
+  }
+
+  for (uint8_t i = 0; i < t->count; i++)
+  {
+    const geofence_t *z = &t->zone[i];
+    if (z->type != GEOFENCE_ZONE_SAFE)
+      continue;
+    if (within(z, lat, lon, (int32_t)z->radius - t->buffer_m))
+      in_safe = true;
+    else if (within(z, lat, lon, z->radius))
+      in_warning = true;
+  }
+
+  if (in_warning)
+    return GEOFENCE_WARNING;
+  return in_safe ? GEOFENCE_SAFE : GEOFENCE_DANGER;
+}
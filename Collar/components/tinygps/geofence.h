@@ -0,0 +1,52 @@
+/*
+Circular safe and danger zones evaluated on the collar. The table arrives
+in a downlink frame and is kept as parsed; a position is checked with a
+flat-earth distance, the haversine distance is only worked out when that
+lands too close to a boundary to decide. The rules are the backend's, so
+both agree on the zone status of a fix.
+*/
+#ifndef geofence_h
+#define geofence_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GEOFENCE_MAX 16        // zones a table may hold
+#define GEOFENCE_HEADER_SIZE 7 // table id (u32), warning buffer (u16), count
+#define GEOFENCE_ENTRY_SIZE 11 // lat, lon (i32, 1e-7 degrees), radius (u16 m), zone type
+#define GEOFENCE_TABLE_SIZE (GEOFENCE_HEADER_SIZE + GEOFENCE_MAX * GEOFENCE_ENTRY_SIZE)
+
+typedef enum {
+  GEOFENCE_ZONE_SAFE,
+  GEOFENCE_ZONE_DANGER
+} geofence_zone_t;
+
+typedef enum {
+  GEOFENCE_UNKNOWN, // no table yet
+  GEOFENCE_SAFE,
+  GEOFENCE_WARNING, // within the warning buffer of a boundary
+  GEOFENCE_DANGER   // inside a danger zone or outside every safe zone
+} geofence_status_t;
+
+typedef struct {
+  int32_t lat; // 1e-7 degrees
+  int32_t lon;
+  uint16_t radius; // m
+  uint8_t type;    // geofence_zone_t
+  float m_per_lon; // m per 1e-7 degrees of longitude at the centre
+} geofence_t;
+
+typedef struct {
+  uint32_t id;       // hash of the content, 0 = no table
+  uint16_t buffer_m; // warning buffer around every boundary
+  uint8_t count;
+  geofence_t zone[GEOFENCE_MAX];
+} geofence_table_t;
+
+// table from the downlink payload following the frame type, false when malformed
+bool geofence_parse(const uint8_t *payload, size_t len, geofence_table_t *t);
+// zone status of lat/lon (1e-7 degrees)
+geofence_status_t geofence_check(const geofence_table_t *t, int32_t lat, int32_t lon);
+
+#endif
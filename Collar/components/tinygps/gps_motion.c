@@ -0,0 +1,75 @@
+#include <string.h>
+#include "gps_motion.h"
+#include "tinygps.h"
+
+static float distance(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+  return gps_distance_between(lat1 / 1e7f, lon1 / 1e7f, lat2 / 1e7f, lon2 / 1e7f);
+}
+
+void gps_motion_init(gps_motion_t *m)
+{
+  memset(m, 0, sizeof(*m));
+}
+
+bool gps_motion_skip(gps_motion_t *m, uint8_t max_skip)
+{
+  if (m->count == 0)
+    return false;
+
+  // The maximum may have been lowered since the interval was chosen
+  if (m->skip_left > max_skip)
+    m->skip_left = max_skip;
+  return m->skip_left > 0;
+}
+
+void gps_motion_reused(gps_motion_t *m)
+{
+  if (m->skip_left > 0)
+    m->skip_left--;
+}
+
+void gps_motion_add_fix(gps_motion_t *m, int32_t lat, int32_t lon, float still_m, uint8_t max_skip)
+{
+  if (m->count > 0)
+  {
+    // Step since the last fix and drift since the oldest one kept
+    float step = distance(m->lat[m->count - 1], m->lon[m->count - 1], lat, lon);
+    float drift = distance(m->lat[0], m->lon[0], lat, lon);
+
+    if (step >= still_m)
+    {
+      // Moving, fix every cycle
+      m->interval = 0;
+    }
+    else if (drift >= 2 * still_m)
+    {
+      // Small steps adding up, grazing slowly
+      m->interval /= 2;
+    }
+    else
+    {
+      // Resting, back off
+      m->interval = m->interval == 0 ? 1 : m->interval * 2;
+    }
+  }
+  if (m->interval > max_skip)
+    m->interval = max_skip;
+  m->skip_left = m->interval;
+
+  if (m->count == GPS_MOTION_HISTORY)
+  {
+    memmove(m->lat, m->lat + 1, sizeof(m->lat[0]) * (GPS_MOTION_HISTORY - 1));
+    memmove(m->lon, m->lon + 1, sizeof(m->lon[0]) * (GPS_MOTION_HISTORY - 1));
+    m->count--;
+  }
+  m->lat[m->count] = lat;
+  m->lon[m->count] = lon;
+  m->count++;
+}
+
+void gps_motion_no_fix(gps_motion_t *m)
+{
+  m->interval = 0;
+  m->skip_left = 0;
+}
@@ -0,0 +1,34 @@
+/*
+Decides per cycle whether a fresh fix is needed or the last one can be
+sent again. Fixes that stay within the noise of each other stretch the
+number of cycles skipped, up to a maximum; a move resets it. The state is
+plain data so it can live in RTC memory across deep sleep.
+*/
+#ifndef gps_motion_h
+#define gps_motion_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GPS_MOTION_HISTORY 4 // accepted fixes kept for the trend
+
+typedef struct {
+  int32_t lat[GPS_MOTION_HISTORY]; // 1e-7 degrees, oldest first
+  int32_t lon[GPS_MOTION_HISTORY];
+  uint8_t count;     // fixes kept
+  uint8_t interval;  // uplinks to skip after the last fix
+  uint8_t skip_left; // uplinks still to skip
+} gps_motion_t;
+
+void gps_motion_init(gps_motion_t *m);
+// true when this cycle may reuse the last fix
+bool gps_motion_skip(gps_motion_t *m, uint8_t max_skip);
+// the last fix went out again in an uplink
+void gps_motion_reused(gps_motion_t *m);
+// an accepted fix, `still_m` is the distance within which the animal is
+// taken to be resting
+void gps_motion_add_fix(gps_motion_t *m, int32_t lat, int32_t lon, float still_m, uint8_t max_skip);
+// the search gave up, try again on the next wake
+void gps_motion_no_fix(gps_motion_t *m);
+
+#endif
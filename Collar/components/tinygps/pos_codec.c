@@ -0,0 +1,43 @@
+#include <math.h>
+#include "pos_codec.h"
+
+#define POS_M_PER_DEG 111194.93 // spherical earth, radius 6371 km
+#define POS_FULL_TURN 3600000000LL // 360 degrees in 1e-7
+
+static double m_per_unit_east(int32_t ref_lat)
+{
+  return POS_M_PER_DEG * 1e-7 * cos(ref_lat * 1e-7 * M_PI / 180.0);
+}
+
+bool pos_encode_offset(int32_t ref_lat, int32_t ref_lon, int32_t lat, int32_t lon,
+                       int16_t *north_m, int16_t *east_m)
+{
+  int64_t dlon = (int64_t)lon - ref_lon;
+  // Shortest way round across the antimeridian
+  if (dlon > POS_FULL_TURN / 2)
+    dlon -= POS_FULL_TURN;
+  else if (dlon < -POS_FULL_TURN / 2)
+    dlon += POS_FULL_TURN;
+
+  double north = round(((int64_t)lat - ref_lat) * POS_M_PER_DEG * 1e-7);
+  double east = round(dlon * m_per_unit_east(ref_lat));
+  if (fabs(north) > POS_CODEC_RANGE_M || fabs(east) > POS_CODEC_RANGE_M)
+    return false;
+
+  *north_m = (int16_t)north;
+  *east_m = (int16_t)east;
+  return true;
+}
+
+void pos_decode_offset(int32_t ref_lat, int32_t ref_lon, int16_t north_m, int16_t east_m,
+                       int32_t *lat, int32_t *lon)
+{
+  int64_t l = ref_lon + llround(east_m / m_per_unit_east(ref_lat));
+  if (l > POS_FULL_TURN / 2)
+    l -= POS_FULL_TURN;
+  else if (l < -POS_FULL_TURN / 2)
+    l += POS_FULL_TURN;
+
+  *lat = ref_lat + (int32_t)llround(north_m / (POS_M_PER_DEG * 1e-7));
+  *lon = (int32_t)l;
+}
@@ -0,0 +1,22 @@
+/*
+Compact position for the uplink: north and east offsets in whole meters
+from a zone reference point. The offsets come from a local equirectangular
+projection at the reference latitude, decoding applies the exact inverse,
+so a round trip only loses the rounding to 1 m.
+*/
+#ifndef pos_codec_h
+#define pos_codec_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define POS_CODEC_RANGE_M 32767 // int16 offsets, further positions go out in full
+
+// offsets of lat/lon (1e-7 degrees) from the reference, false when out of range
+bool pos_encode_offset(int32_t ref_lat, int32_t ref_lon, int32_t lat, int32_t lon,
+                       int16_t *north_m, int16_t *east_m);
+// position (1e-7 degrees) of the offsets from the reference
+void pos_decode_offset(int32_t ref_lat, int32_t ref_lon, int16_t north_m, int16_t east_m,
+                       int32_t *lat, int32_t *lon);
+
+#endif
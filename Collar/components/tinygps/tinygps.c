@@ -21,39 +21,25 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include <math.h>
+#include <string.h>
 #include <time.h>
 #include "tinygps.h"
 
-// properties
-unsigned long _time, _new_time;
-unsigned long _date, _new_date;
-long _latitude, _new_latitude;
-long _longitude, _new_longitude;
-long _altitude, _new_altitude;
-unsigned long  _speed, _new_speed;
-unsigned long  _course, _new_course;
-unsigned long  _hdop, _new_hdop;
-unsigned short _numsats, _new_numsats;
-
-unsigned long _last_time_fix, _new_time_fix;
-unsigned long _last_position_fix, _new_position_fix;
-
-// parsing state variables
-uint8_t _parity;
-bool _is_checksum_term;
-char _term[15];
-uint8_t _sentence_type;
-uint8_t _term_number = 0;
-uint8_t _term_offset = 0;
-bool _is_gps_data_good;
+// parser used by the single-instance functions (gps_encode() and friends)
+static gps_ctx_t _gps;
+static bool _gps_initialized = false;
 
-#ifndef GPS_NO_STATS
-  // statistics
-  unsigned long _encoded_characters;
-  unsigned short _good_sentences;
-  unsigned short _failed_checksum;
-  unsigned short _passed_checksum;
-#endif
+static gps_ctx_t *default_ctx()
+{
+  if (!_gps_initialized)
+  {
+    gps_ctx_init(&_gps);
+    _gps_initialized = true;
+  }
+  return &_gps;
+}
+
+static bool gps_term_complete(gps_ctx_t *ctx);
 
 //
 // public methods
@@ -63,19 +49,13 @@ bool _is_gps_data_good;
 bool gpsisdigit(char c) { return c >= '0' && c <= '9'; }
 
 // signed altitude in centimeters (from GPGGA sentence)
-inline long altitude() { return _altitude; }
+static inline long altitude() { return default_ctx()->fix.altitude; }
 
 // course in last full GPRMC sentence in 100th of a degree
-inline unsigned long course() { return _course; }
+static inline unsigned long course() { return default_ctx()->fix.course; }
 
 // speed in last full GPRMC sentence in 100ths of a knot
-inline unsigned long speed() { return _speed; }
-
-// satellites used in last full GPGGA sentence
-inline unsigned short gps_satellites() { return _numsats; }
-
-// horizontal dilution of precision in 100ths
-inline unsigned long gps_hdop() { return _hdop; }
+static inline unsigned long speed() { return default_ctx()->fix.speed; }
 
 
 clock_t uptime()
@@ -93,58 +73,118 @@ float degrees(float rad)
 	return rad * (180/PI);
 }
 
-bool gps_encode(char c)
+void gps_ctx_init(gps_ctx_t *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->fix.latitude = GPS_INVALID_ANGLE;
+  ctx->fix.longitude = GPS_INVALID_ANGLE;
+  ctx->fix.altitude = GPS_INVALID_ALTITUDE;
+  ctx->fix.speed = GPS_INVALID_SPEED;
+  ctx->fix.course = GPS_INVALID_ANGLE;
+  ctx->fix.hdop = GPS_INVALID_HDOP;
+  ctx->fix.satellites = GPS_INVALID_SATELLITES;
+  ctx->fix.date = GPS_INVALID_DATE;
+  ctx->fix.time = GPS_INVALID_TIME;
+  ctx->last_time_fix = GPS_INVALID_FIX_TIME;
+  ctx->last_position_fix = GPS_INVALID_FIX_TIME;
+  ctx->sentence_type = GPS_SENTENCE_OTHER;
+}
+
+bool gps_ctx_encode(gps_ctx_t *ctx, char c)
 {
   bool valid_sentence = false;
 
 #ifndef GPS_NO_STATS
-  _encoded_characters++;
+  ctx->encoded_characters++;
 #endif
   switch(c)
   {
   case ',': // term terminators
-    _parity ^= c;
+    ctx->parity ^= c;
+    // fall through
   case '\r':
   case '\n':
   case '*':
-    if (_term_offset < sizeof(_term))
+    if (ctx->term_offset < sizeof(ctx->term))
     {
-      _term[_term_offset] = 0;
-      valid_sentence = gps_term_complete();
+      ctx->term[ctx->term_offset] = 0;
+      valid_sentence = gps_term_complete(ctx);
     }
-    ++_term_number;
-    _term_offset = 0;
-    _is_checksum_term = c == '*';
+    // saturate, wrapping to 0 would retype the sentence
+    if (ctx->term_number < UINT8_MAX)
+      ++ctx->term_number;
+    ctx->term_offset = 0;
+    ctx->is_checksum_term = c == '*';
     return valid_sentence;
 
   case '$': // sentence begin
-    _term_number = 0;
-    _term_offset = 0;
-    _parity = 0;
-    _sentence_type = GPS_SENTENCE_OTHER;
-    _is_checksum_term = false;
-    _is_gps_data_good = false;
+    ctx->term_number = 0;
+    ctx->term_offset = 0;
+    ctx->parity = 0;
+    ctx->sentence_type = GPS_SENTENCE_OTHER;
+    ctx->is_checksum_term = false;
+    ctx->is_gps_data_good = false;
     return valid_sentence;
   }
 
   // ordinary characters
-  if (_term_offset < sizeof(_term) - 1)
-    _term[_term_offset++] = c;
-  if (!_is_checksum_term)
-    _parity ^= c;
+  if (ctx->term_offset < sizeof(ctx->term) - 1)
+    ctx->term[ctx->term_offset++] = c;
+  if (!ctx->is_checksum_term)
+    ctx->parity ^= c;
+
+  return valid_sentence;
+}
+
+bool gps_ctx_encode_line(gps_ctx_t *ctx, const char *line, size_t len)
+{
+  bool valid_sentence = false;
+
+  for (size_t i = 0; i < len; i++)
+    if (gps_ctx_encode(ctx, line[i]))
+      valid_sentence = true;
+
+  // the checksum term only completes at the line end
+  if (len == 0 || (line[len - 1] != '\n' && line[len - 1] != '\r'))
+    if (gps_ctx_encode(ctx, '\n'))
+      valid_sentence = true;
 
   return valid_sentence;
 }
 
+bool gps_ctx_get_fix(const gps_ctx_t *ctx, gps_fix_t *fix)
+{
+  unsigned long now = uptime();
+
+  *fix = ctx->fix;
+  fix->fix_age = ctx->last_position_fix == GPS_INVALID_FIX_TIME ?
+    GPS_INVALID_AGE : now - ctx->last_position_fix;
+  fix->time_age = ctx->last_time_fix == GPS_INVALID_FIX_TIME ?
+    GPS_INVALID_AGE : now - ctx->last_time_fix;
+  return ctx->last_position_fix != GPS_INVALID_FIX_TIME;
+}
+
 #ifndef GPS_NO_STATS
-void gps_stats(unsigned long *chars, unsigned short *sentences, unsigned short *failed_cs)
+void gps_ctx_stats(const gps_ctx_t *ctx, unsigned long *chars, unsigned short *sentences, unsigned short *failed_cs)
 {
   if (chars)
-	*chars = _encoded_characters;
+	*chars = ctx->encoded_characters;
   if (sentences)
-	*sentences = _good_sentences;
+	*sentences = ctx->good_sentences;
   if (failed_cs)
-	*failed_cs = _failed_checksum;
+	*failed_cs = ctx->failed_checksum;
+}
+#endif
+
+bool gps_encode(char c)
+{
+  return gps_ctx_encode(default_ctx(), c);
+}
+
+#ifndef GPS_NO_STATS
+void gps_stats(unsigned long *chars, unsigned short *sentences, unsigned short *failed_cs)
+{
+  gps_ctx_stats(default_ctx(), chars, sentences, failed_cs);
 }
 #endif
 
@@ -162,13 +202,13 @@ int from_hex(char a)
     return a - '0';
 }
 
-unsigned long gps_parse_decimal()
+static unsigned long gps_parse_decimal(const char *term)
 {
-  char *p;
+  const char *p;
   bool isneg;
   unsigned long ret;
 
-  p = _term;
+  p = term;
   isneg = (*p == '-');
   if (isneg)
 	++p;
@@ -190,67 +230,73 @@ unsigned long gps_parse_decimal()
   return isneg ? -ret : ret;
 }
 
-unsigned long gps_parse_degrees()
+// dddmm.mmmmm to 1e-7 degrees
+static long gps_parse_degrees(const char *term)
 {
-  char *p;
+  const char *p;
   unsigned long left;
-  unsigned long tenk_minutes;
+  unsigned long hundredk_minutes;
 
-  left = gpsatol(_term);
-  tenk_minutes = (left % 100UL) * 10000UL;
+  left = gpsatol(term);
+  hundredk_minutes = (left % 100UL) * 100000UL;
 
-  for (p=_term; gpsisdigit(*p); ++p);
+  for (p=term; gpsisdigit(*p); ++p);
 
   if (*p == '.')
   {
-    unsigned long mult = 1000;
+    unsigned long mult = 10000;
     while (gpsisdigit(*++p))
     {
-      tenk_minutes += mult * (*p - '0');
+      hundredk_minutes += mult * (*p - '0');
       mult /= 10;
     }
   }
-  return (left / 100) * 100000 + tenk_minutes / 6;
+  return (left / 100) * 10000000L + (hundredk_minutes * 10 + 3) / 6;
 }
 
 #define COMBINE(sentence_type, term_number) (((unsigned)(sentence_type) << 5) | term_number)
+#define MAX_TERM_NUMBER 31 // COMBINE() keeps 5 bits, later terms would alias fields of another sentence
 
 /* Processes a just-completed term
  * Returns true if new sentence has just passed checksum test and is validated
  */
-bool gps_term_complete()
+static bool gps_term_complete(gps_ctx_t *ctx)
 {
-  if (_is_checksum_term)
+  gps_fix_t *fix = &ctx->fix;
+  gps_fix_t *new_fix = &ctx->new_fix;
+  const char *term = ctx->term;
+
+  if (ctx->is_checksum_term)
   {
     uint8_t checksum;
-    checksum = 16 * from_hex(_term[0]) + from_hex(_term[1]);
-    if (checksum == _parity)
+    checksum = 16 * from_hex(term[0]) + from_hex(term[1]);
+    if (checksum == ctx->parity)
     {
-      if (_is_gps_data_good)
+      if (ctx->is_gps_data_good)
       {
 #ifndef GPS_NO_STATS
-        ++_good_sentences;
+        ++ctx->good_sentences;
 #endif
-        _last_time_fix = _new_time_fix;
-        _last_position_fix = _new_position_fix;
+        ctx->last_time_fix = ctx->new_time_fix;
+        ctx->last_position_fix = ctx->new_position_fix;
 
-        switch(_sentence_type)
+        switch(ctx->sentence_type)
         {
         case GPS_SENTENCE_GPRMC:
-          _time      = _new_time;
-          _date      = _new_date;
-          _latitude  = _new_latitude;
-          _longitude = _new_longitude;
-          _speed     = _new_speed;
-          _course    = _new_course;
+          fix->time      = new_fix->time;
+          fix->date      = new_fix->date;
+          fix->latitude  = new_fix->latitude;
+          fix->longitude = new_fix->longitude;
+          fix->speed     = new_fix->speed;
+          fix->course    = new_fix->course;
           break;
         case GPS_SENTENCE_GPGGA:
-          _altitude  = _new_altitude;
-          _time      = _new_time;
-          _latitude  = _new_latitude;
-          _longitude = _new_longitude;
-          _numsats   = _new_numsats;
-          _hdop      = _new_hdop;
+          fix->altitude   = new_fix->altitude;
+          fix->time       = new_fix->time;
+          fix->latitude   = new_fix->latitude;
+          fix->longitude  = new_fix->longitude;
+          fix->satellites = new_fix->satellites;
+          fix->hdop       = new_fix->hdop;
           break;
         }
 
@@ -260,73 +306,73 @@ bool gps_term_complete()
 
 #ifndef GPS_NO_STATS
     else
-      ++_failed_checksum;
+      ++ctx->failed_checksum;
 #endif
     return false;
   }
 
   // the first term determines the sentence type
-  if (_term_number == 0)
+  if (ctx->term_number == 0)
   {
-    if (!gpsstrcmp(_term, GPRMC_TERM))
-      _sentence_type = GPS_SENTENCE_GPRMC;
-    else if (!gpsstrcmp(_term, GPGGA_TERM))
-      _sentence_type = GPS_SENTENCE_GPGGA;
+    if (!gpsstrcmp(term, GPRMC_TERM))
+      ctx->sentence_type = GPS_SENTENCE_GPRMC;
+    else if (!gpsstrcmp(term, GPGGA_TERM))
+      ctx->sentence_type = GPS_SENTENCE_GPGGA;
     else
-      _sentence_type = GPS_SENTENCE_OTHER;
+      ctx->sentence_type = GPS_SENTENCE_OTHER;
     return false;
   }
 
-  if (_sentence_type != GPS_SENTENCE_OTHER && _term[0])
-    switch(COMBINE(_sentence_type, _term_number))
+  if (ctx->sentence_type != GPS_SENTENCE_OTHER && term[0] && ctx->term_number <= MAX_TERM_NUMBER)
+    switch(COMBINE(ctx->sentence_type, ctx->term_number))
   {
     case COMBINE(GPS_SENTENCE_GPRMC, 1): // Time in both sentences
     case COMBINE(GPS_SENTENCE_GPGGA, 1):
-      _new_time = gps_parse_decimal();
-      _new_time_fix = uptime();
+      new_fix->time = gps_parse_decimal(term);
+      ctx->new_time_fix = uptime();
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 2): // GPRMC validity
-      _is_gps_data_good = (_term[0] == 'A');
+      ctx->is_gps_data_good = (term[0] == 'A');
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 3): // Latitude
     case COMBINE(GPS_SENTENCE_GPGGA, 2):
-      _new_latitude = gps_parse_degrees();
-      _new_position_fix = uptime();
+      new_fix->latitude = gps_parse_degrees(term);
+      ctx->new_position_fix = uptime();
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 4): // N/S
     case COMBINE(GPS_SENTENCE_GPGGA, 3):
-      if (_term[0] == 'S')
-        _new_latitude = -_new_latitude;
+      if (term[0] == 'S')
+        new_fix->latitude = -new_fix->latitude;
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 5): // Longitude
     case COMBINE(GPS_SENTENCE_GPGGA, 4):
-      _new_longitude = gps_parse_degrees();
+      new_fix->longitude = gps_parse_degrees(term);
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 6): // E/W
     case COMBINE(GPS_SENTENCE_GPGGA, 5):
-      if (_term[0] == 'W')
-        _new_longitude = -_new_longitude;
+      if (term[0] == 'W')
+        new_fix->longitude = -new_fix->longitude;
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 7): // Speed (GPRMC)
-      _new_speed = gps_parse_decimal();
+      new_fix->speed = gps_parse_decimal(term);
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 8): // Course (GPRMC)
-      _new_course = gps_parse_decimal();
+      new_fix->course = gps_parse_decimal(term);
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 9): // Date (GPRMC)
-      _new_date = gpsatol(_term);
+      new_fix->date = gpsatol(term);
       break;
     case COMBINE(GPS_SENTENCE_GPGGA, 6): // Fix data (GPGGA)
-      _is_gps_data_good = (_term[0] > '0');
+      ctx->is_gps_data_good = (term[0] > '0');
       break;
     case COMBINE(GPS_SENTENCE_GPGGA, 7): // Satellites used (GPGGA)
-      _new_numsats = (unsigned char)atoi(_term);
+      new_fix->satellites = (uint8_t)gpsatol(term);
       break;
     case COMBINE(GPS_SENTENCE_GPGGA, 8): // HDOP
-      _new_hdop = gps_parse_decimal();
+      new_fix->hdop = gps_parse_decimal(term);
       break;
     case COMBINE(GPS_SENTENCE_GPGGA, 9): // Altitude (GPGGA)
-      _new_altitude = gps_parse_decimal();
+      new_fix->altitude = gps_parse_decimal(term);
       break;
   }
 
@@ -405,25 +451,29 @@ const char *gps_cardinal (float course)
 // lat/long in hundred thousandths of a degree and age of fix in milliseconds
 void gps_get_position(long *latitude, long *longitude, unsigned long *fix_age)
 {
+  gps_fix_t fix;
+  bool valid = gps_ctx_get_fix(default_ctx(), &fix);
+
   if (latitude)
-	*latitude = _latitude;
+	*latitude = valid ? fix.latitude / 100 : GPS_INVALID_ANGLE;
   if (longitude)
-	*longitude = _longitude;
+	*longitude = valid ? fix.longitude / 100 : GPS_INVALID_ANGLE;
   if (fix_age)
-	*fix_age = (_last_position_fix == GPS_INVALID_FIX_TIME) ? 
-		GPS_INVALID_AGE : uptime() - _last_position_fix;
+	*fix_age = fix.fix_age;
 }
 
 // date as ddmmyy, time as hhmmsscc, and age in milliseconds
 void gps_get_datetime(unsigned long *date, unsigned long *time, unsigned long *age)
 {
+  gps_fix_t fix;
+  gps_ctx_get_fix(default_ctx(), &fix);
+
   if (date)
-	*date = _date;
+	*date = fix.date;
   if (time)
-	*time = _time;
+	*time = fix.time;
   if (age)
-	*age = _last_time_fix == GPS_INVALID_FIX_TIME ? 
-		GPS_INVALID_AGE : uptime() - _last_time_fix;
+	*age = fix.time_age;
 }
 
 void gps_f_get_position(float *latitude, float *longitude, unsigned long *fix_age)
@@ -454,17 +504,17 @@ void gps_crack_datetime(int *year, uint8_t *month, uint8_t *day,
 
 float gps_f_altitude()    
 {
-  return _altitude == GPS_INVALID_ALTITUDE ? GPS_INVALID_F_ALTITUDE : _altitude / 100.0;
+  return altitude() == GPS_INVALID_ALTITUDE ? GPS_INVALID_F_ALTITUDE : altitude() / 100.0;
 }
 
 float gps_f_course()
 {
-  return _course == GPS_INVALID_ANGLE ? GPS_INVALID_F_ANGLE : _course / 100.0;
+  return course() == GPS_INVALID_ANGLE ? GPS_INVALID_F_ANGLE : course() / 100.0;
 }
 
 float gps_f_speed_knots() 
 {
-  return _speed == GPS_INVALID_SPEED ? GPS_INVALID_F_SPEED : _speed / 100.0;
+  return speed() == GPS_INVALID_SPEED ? GPS_INVALID_F_SPEED : speed() / 100.0;
 }
 
 float gps_f_speed_mph()   
@@ -20,6 +20,8 @@ License along with this library; if not, write to the Free Software
 Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifndef tinygps_h
 #define tinygps_h
@@ -60,6 +62,57 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
     GPS_INVALID_HDOP = 0xFFFFFFFF
   };
 
+  // Fix as committed by the last valid GGA/RMC sentence, integers only
+  typedef struct {
+    int32_t latitude;        // 1e-7 degrees, north positive
+    int32_t longitude;       // 1e-7 degrees, east positive
+    int32_t altitude;        // centimeters
+    uint32_t speed;          // 100ths of a knot
+    uint32_t course;         // 100ths of a degree
+    uint32_t hdop;           // 100ths
+    uint8_t satellites;
+    uint32_t h_acc;          // mm, horizontal accuracy estimate (UBX only, 0 = unknown)
+    uint32_t date;           // ddmmyy
+    uint32_t time;           // UTC hhmmsscc
+    unsigned long fix_age;   // ms since the position was received, GPS_INVALID_AGE if never
+    unsigned long time_age;  // ms since the time was received, GPS_INVALID_AGE if never
+  } gps_fix_t;
+
+  // Parser state and the last fix, one per receiver (or per test)
+  typedef struct {
+    gps_fix_t fix;
+    gps_fix_t new_fix; // terms of the sentence being parsed
+    unsigned long last_time_fix, new_time_fix;
+    unsigned long last_position_fix, new_position_fix;
+
+    uint8_t parity;
+    bool is_checksum_term;
+    char term[15];
+    uint8_t sentence_type;
+    uint8_t term_number;
+    uint8_t term_offset;
+    bool is_gps_data_good;
+
+#ifndef GPS_NO_STATS
+    unsigned long encoded_characters;
+    unsigned short good_sentences;
+    unsigned short failed_checksum;
+#endif
+  } gps_ctx_t;
+
+  void gps_ctx_init(gps_ctx_t *ctx);
+  // process one character, true when it completed a valid sentence
+  bool gps_ctx_encode(gps_ctx_t *ctx, char c);
+  // process one sentence ("$...*hh", line end optional), true when it was valid
+  bool gps_ctx_encode_line(gps_ctx_t *ctx, const char *line, size_t len);
+  // last fix with its age, false until a position has been received
+  bool gps_ctx_get_fix(const gps_ctx_t *ctx, gps_fix_t *fix);
+#ifndef GPS_NO_STATS
+  void gps_ctx_stats(const gps_ctx_t *ctx, unsigned long *chars, unsigned short *good_sentences, unsigned short *failed_cs);
+#endif
+
+  // The functions below work on a single global parser
+
   // process one character received from GPS
   bool gps_encode(char c);
 
@@ -79,6 +132,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
   float gps_f_speed_mps();
   float gps_f_speed_kmph();
   
+  // great-circle distance in meters and course in degrees between two
+  // positions in signed decimal degrees
+  float gps_distance_between(float lat1, float long1, float lat2, float long2);
+  float gps_course_to(float lat1, float long1, float lat2, float long2);
+
 #ifndef GPS_NO_STATS
   void gps_stats(unsigned long *chars, unsigned short *good_sentences, unsigned short *failed_cs);
 #endif
@@ -91,9 +149,6 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
   // internal utilities
   int from_hex(char a);
-  unsigned long gps_parse_decimal();
-  unsigned long gps_parse_degrees();
-  bool gps_term_complete();
   bool gpsisdigit(char c);
   long gpsatol(const char *str);
   int gpsstrcmp(const char *str1, const char *str2);
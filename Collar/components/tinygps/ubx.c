@@ -0,0 +1,259 @@
+/*
+UBX binary protocol support, see ubx.h.
+*/
+
+#include <string.h>
+#include <time.h>
+#include "ubx.h"
+
+enum {
+  UBX_STATE_SYNC_1,
+  UBX_STATE_SYNC_2,
+  UBX_STATE_CLASS,
+  UBX_STATE_ID,
+  UBX_STATE_LENGTH_1,
+  UBX_STATE_LENGTH_2,
+  UBX_STATE_PAYLOAD,
+  UBX_STATE_CK_A,
+  UBX_STATE_CK_B
+};
+
+static uint16_t get_u2(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t get_u4(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static void put_u2(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put_u4(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+// 8-bit Fletcher checksum over class, id, length and payload
+static void checksum_add(ubx_ctx_t *ctx, uint8_t c)
+{
+  ctx->ck_a += c;
+  ctx->ck_b += ctx->ck_a;
+}
+
+void ubx_init(ubx_ctx_t *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->state = UBX_STATE_SYNC_1;
+}
+
+bool ubx_decode(ubx_ctx_t *ctx, uint8_t c)
+{
+  switch (ctx->state)
+  {
+  case UBX_STATE_SYNC_1:
+    if (c == UBX_SYNC_1)
+      ctx->state = UBX_STATE_SYNC_2;
+    return false;
+
+  case UBX_STATE_SYNC_2:
+    if (c == UBX_SYNC_2)
+    {
+      ctx->ck_a = 0;
+      ctx->ck_b = 0;
+      ctx->state = UBX_STATE_CLASS;
+    }
+    else
+      ctx->state = c == UBX_SYNC_1 ? UBX_STATE_SYNC_2 : UBX_STATE_SYNC_1;
+    return false;
+
+  case UBX_STATE_CLASS:
+    ctx->msg_class = c;
+    checksum_add(ctx, c);
+    ctx->state = UBX_STATE_ID;
+    return false;
+
+  case UBX_STATE_ID:
+    ctx->msg_id = c;
+    checksum_add(ctx, c);
+    ctx->state = UBX_STATE_LENGTH_1;
+    return false;
+
+  case UBX_STATE_LENGTH_1:
+    ctx->length = c;
+    checksum_add(ctx, c);
+    ctx->state = UBX_STATE_LENGTH_2;
+    return false;
+
+  case UBX_STATE_LENGTH_2:
+    ctx->length |= c << 8;
+    if (ctx->length > UBX_MAX_LENGTH)
+    {
+      // Waiting out up to 64 KB would drop every frame behind it
+      ctx->state = UBX_STATE_SYNC_1;
+      return false;
+    }
+    checksum_add(ctx, c);
+    ctx->offset = 0;
+    ctx->overflow = ctx->length > UBX_MAX_PAYLOAD;
+    ctx->state = ctx->length ? UBX_STATE_PAYLOAD : UBX_STATE_CK_A;
+    return false;
+
+  case UBX_STATE_PAYLOAD:
+    if (ctx->offset < UBX_MAX_PAYLOAD)
+      ctx->payload[ctx->offset] = c;
+    checksum_add(ctx, c);
+    if (++ctx->offset == ctx->length)
+      ctx->state = UBX_STATE_CK_A;
+    return false;
+
+  case UBX_STATE_CK_A:
+    if (c != ctx->ck_a)
+    {
+      ++ctx->failed_checksum;
+      ctx->state = c == UBX_SYNC_1 ? UBX_STATE_SYNC_2 : UBX_STATE_SYNC_1;
+      return false;
+    }
+    ctx->state = UBX_STATE_CK_B;
+    return false;
+
+  case UBX_STATE_CK_B:
+    ctx->state = UBX_STATE_SYNC_1;
+    if (c != ctx->ck_b)
+    {
+      ++ctx->failed_checksum;
+      if (c == UBX_SYNC_1)
+        ctx->state = UBX_STATE_SYNC_2;
+      return false;
+    }
+    ++ctx->good_frames;
+    return !ctx->overflow;
+  }
+
+  ctx->state = UBX_STATE_SYNC_1;
+  return false;
+}
+
+bool ubx_nav_pvt(const ubx_ctx_t *ctx, ubx_nav_pvt_t *pvt)
+{
+  const uint8_t *p = ctx->payload;
+
+  if (ctx->msg_class != UBX_CLASS_NAV || ctx->msg_id != UBX_NAV_PVT || ctx->length < UBX_NAV_PVT_LEN)
+    return false;
+
+  pvt->itow     = get_u4(p + 0);
+  pvt->year     = get_u2(p + 4);
+  pvt->month    = p[6];
+  pvt->day      = p[7];
+  pvt->hour     = p[8];
+  pvt->minute   = p[9];
+  pvt->second   = p[10];
+  pvt->valid    = p[11];
+  pvt->fix_type = p[20];
+  pvt->flags    = p[21];
+  pvt->num_sv   = p[23];
+  pvt->lon      = (int32_t)get_u4(p + 24);
+  pvt->lat      = (int32_t)get_u4(p + 28);
+  pvt->h_msl    = (int32_t)get_u4(p + 36);
+  pvt->h_acc    = get_u4(p + 40);
+  pvt->v_acc    = get_u4(p + 44);
+  pvt->g_speed  = (int32_t)get_u4(p + 60);
+  pvt->head_mot = (int32_t)get_u4(p + 64);
+  pvt->p_dop    = get_u2(p + 76);
+  return true;
+}
+
+bool ubx_pvt_has_fix(const ubx_nav_pvt_t *pvt)
+{
+  return (pvt->flags & UBX_PVT_FLAGS_GNSS_FIX_OK) &&
+    (pvt->fix_type == UBX_FIX_2D || pvt->fix_type == UBX_FIX_3D || pvt->fix_type == UBX_FIX_GNSS_DR);
+}
+
+void ubx_pvt_to_fix(const ubx_nav_pvt_t *pvt, gps_fix_t *fix)
+{
+  fix->latitude = pvt->lat;
+  fix->longitude = pvt->lon;
+  fix->altitude = pvt->h_msl / 10;
+  // mm/s to 100ths of a knot (1 knot = 514.444 mm/s)
+  fix->speed = pvt->g_speed > 0 ? (uint32_t)(((int64_t)pvt->g_speed * 100000 + 257222) / 514444) : 0;
+  fix->course = pvt->head_mot / 1000;
+  // NAV-PVT only has PDOP, which is not HDOP; the accuracy estimate is the gate
+  fix->hdop = GPS_INVALID_HDOP;
+  fix->satellites = pvt->num_sv;
+  fix->h_acc = pvt->h_acc;
+  fix->date = (pvt->valid & UBX_PVT_VALID_DATE) ?
+    pvt->day * 10000UL + pvt->month * 100UL + pvt->year % 100 : GPS_INVALID_DATE;
+  fix->time = (pvt->valid & UBX_PVT_VALID_TIME) ?
+    pvt->hour * 1000000UL + pvt->minute * 10000UL + pvt->second * 100UL : GPS_INVALID_TIME;
+  fix->fix_age = 0;
+  fix->time_age = 0;
+}
+
+size_t ubx_frame(uint8_t msg_class, uint8_t msg_id, const uint8_t *payload, uint16_t len, uint8_t *out)
+{
+  ubx_ctx_t ck = { .ck_a = 0, .ck_b = 0 };
+
+  out[0] = UBX_SYNC_1;
+  out[1] = UBX_SYNC_2;
+  out[2] = msg_class;
+  out[3] = msg_id;
+  put_u2(out + 4, len);
+  if (len)
+    memmove(out + 6, payload, len);
+  for (size_t i = 2; i < 6 + (size_t)len; i++)
+    checksum_add(&ck, out[i]);
+  out[6 + len] = ck.ck_a;
+  out[7 + len] = ck.ck_b;
+  return len + UBX_FRAME_OVERHEAD;
+}
+
+size_t ubx_cfg_prt_uart(uint32_t baud, uint16_t out_proto, uint8_t *out)
+{
+  uint8_t payload[20] = { 0 };
+
+  payload[0] = 1;                             // UART1
+  put_u4(payload + 4, 0x000008D0);            // 8 data bits, no parity, 1 stop bit
+  put_u4(payload + 8, baud);
+  put_u2(payload + 12, UBX_PROTO_UBX | UBX_PROTO_NMEA);
+  put_u2(payload + 14, out_proto);
+  return ubx_frame(UBX_CLASS_CFG, UBX_CFG_PRT, payload, sizeof(payload), out);
+}
+
+size_t ubx_cfg_msg_rate(uint8_t msg_class, uint8_t msg_id, uint8_t rate, uint8_t *out)
+{
+  uint8_t payload[3] = { msg_class, msg_id, rate };
+
+  return ubx_frame(UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload), out);
+}
+
+size_t ubx_rxm_pmreq_backup(uint32_t duration_ms, uint8_t *out)
+{
+  uint8_t payload[16] = { 0 };
+
+  // version 0 with wakeup sources (protocol 18+), older receivers
+  // ignore it and stay on
+  put_u4(payload + 4, duration_ms);
+  put_u4(payload + 8, UBX_PMREQ_BACKUP);
+  put_u4(payload + 12, UBX_PMREQ_WAKE_UARTRX);
+  return ubx_frame(UBX_CLASS_RXM, UBX_RXM_PMREQ, payload, sizeof(payload), out);
+}
+
+size_t ubx_mga_ini_time_utc(uint32_t unix_time, uint16_t acc_s, uint8_t *out)
+{
+  uint8_t payload[24] = { 0 };
+  time_t t = unix_time;
+  struct tm utc;
+  gmtime_r(&t, &utc);
+
+  payload[0] = 0x10;          // TIME_UTC
+  payload[3] = (uint8_t)-128; // leap seconds unknown
+  put_u2(payload + 4, utc.tm_year + 1900);
+  payload[6] = utc.tm_mon + 1;
+  payload[7] = utc.tm_mday;
+  payload[8] = utc.tm_hour;
+  payload[9] = utc.tm_min;
+  payload[10] = utc.tm_sec;
+  put_u2(payload + 16, acc_s);
+  return ubx_frame(UBX_CLASS_MGA, UBX_MGA_INI, payload, sizeof(payload), out);
+}
+
+size_t ubx_mga_ini_pos_llh(int32_t lat, int32_t lon, int32_t alt_cm, uint32_t acc_cm, uint8_t *out)
+{
+  uint8_t payload[20] = { 0 };
+
+  payload[0] = 0x01; // POS_LLH
+  put_u4(payload + 4, lat);
+  put_u4(payload + 8, lon);
+  put_u4(payload + 12, alt_cm);
+  put_u4(payload + 16, acc_cm);
+  return ubx_frame(UBX_CLASS_MGA, UBX_MGA_INI, payload, sizeof(payload), out);
+}
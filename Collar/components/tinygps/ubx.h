@@ -0,0 +1,114 @@
+/*
+UBX binary protocol support for u-blox receivers: a checksummed frame
+decoder, the NAV-PVT solution message and the few CFG frames needed to
+switch the receiver to it. NAV-PVT needs protocol version 14 or later
+(u-blox 7 and newer).
+*/
+#ifndef ubx_h
+#define ubx_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "tinygps.h"
+
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+#define UBX_FRAME_OVERHEAD 8 // sync, class, id, length, checksum
+#define UBX_MAX_PAYLOAD 100  // largest message we decode (NAV-PVT is 92)
+#define UBX_MAX_LENGTH 1024  // longer is a false sync or a damaged header
+
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_RXM 0x02
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_MGA 0x13
+#define UBX_NAV_PVT 0x07
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_MSG 0x01
+#define UBX_RXM_PMREQ 0x41
+#define UBX_MGA_INI 0x40
+
+#define UBX_NAV_PVT_LEN 92
+
+// CFG-PRT protocol masks
+#define UBX_PROTO_UBX 0x0001
+#define UBX_PROTO_NMEA 0x0002
+
+// RXM-PMREQ flags and wakeup sources
+#define UBX_PMREQ_BACKUP 0x00000002
+#define UBX_PMREQ_WAKE_UARTRX 0x00000008
+
+// NAV-PVT fixType
+enum {
+  UBX_FIX_NONE = 0,
+  UBX_FIX_DEAD_RECKONING = 1,
+  UBX_FIX_2D = 2,
+  UBX_FIX_3D = 3,
+  UBX_FIX_GNSS_DR = 4,
+  UBX_FIX_TIME_ONLY = 5
+};
+
+// NAV-PVT valid / flags bits
+#define UBX_PVT_VALID_DATE 0x01
+#define UBX_PVT_VALID_TIME 0x02
+#define UBX_PVT_FLAGS_GNSS_FIX_OK 0x01
+
+typedef struct {
+  uint8_t state;
+  uint8_t msg_class;
+  uint8_t msg_id;
+  uint16_t length;
+  uint16_t offset;
+  uint8_t ck_a, ck_b;
+  uint8_t payload[UBX_MAX_PAYLOAD];
+  bool overflow; // payload longer than the buffer, checked but not kept
+
+  unsigned long good_frames;
+  unsigned short failed_checksum;
+} ubx_ctx_t;
+
+// Navigation solution, units as sent by the receiver
+typedef struct {
+  uint32_t itow;      // ms of the GPS week
+  uint16_t year;
+  uint8_t month, day, hour, minute, second;
+  uint8_t valid;      // UBX_PVT_VALID_*
+  uint8_t fix_type;   // UBX_FIX_*
+  uint8_t flags;      // UBX_PVT_FLAGS_*
+  uint8_t num_sv;
+  int32_t lon;        // 1e-7 degrees
+  int32_t lat;        // 1e-7 degrees
+  int32_t h_msl;      // mm above mean sea level
+  uint32_t h_acc;     // mm, horizontal accuracy estimate
+  uint32_t v_acc;     // mm
+  int32_t g_speed;    // mm/s ground speed
+  int32_t head_mot;   // 1e-5 degrees heading of motion
+  uint16_t p_dop;     // 0.01
+} ubx_nav_pvt_t;
+
+void ubx_init(ubx_ctx_t *ctx);
+// process one byte, true when it completed a frame with a valid checksum
+bool ubx_decode(ubx_ctx_t *ctx, uint8_t c);
+// decode a NAV-PVT payload, false if the frame is something else
+bool ubx_nav_pvt(const ubx_ctx_t *ctx, ubx_nav_pvt_t *pvt);
+// true for a 2D/3D fix the receiver marks as within its accuracy limits
+bool ubx_pvt_has_fix(const ubx_nav_pvt_t *pvt);
+// the NAV-PVT solution in the units of the NMEA parser (hdop holds the PDOP)
+void ubx_pvt_to_fix(const ubx_nav_pvt_t *pvt, gps_fix_t *fix);
+
+// frame builders, return the frame length written to out
+size_t ubx_frame(uint8_t msg_class, uint8_t msg_id, const uint8_t *payload, uint16_t len, uint8_t *out);
+// UART1 at `baud` 8N1, accepting UBX and NMEA, sending `out_proto`
+size_t ubx_cfg_prt_uart(uint32_t baud, uint16_t out_proto, uint8_t *out);
+// output rate of a message on the current port, 0 disables it
+size_t ubx_cfg_msg_rate(uint8_t msg_class, uint8_t msg_id, uint8_t rate, uint8_t *out);
+// backup mode for `duration_ms` (0 = until woken), woken early by activity
+// on the UART RX line. Ephemeris and time are kept for a hot start.
+size_t ubx_rxm_pmreq_backup(uint32_t duration_ms, uint8_t *out);
+// assistance for a start without ephemeris or time (u-blox M8 and later):
+// UTC time with its accuracy in seconds
+size_t ubx_mga_ini_time_utc(uint32_t unix_time, uint16_t acc_s, uint8_t *out);
+// rough position, 1e-7 degrees, altitude and accuracy in cm
+size_t ubx_mga_ini_pos_llh(int32_t lat, int32_t lon, int32_t alt_cm, uint32_t acc_cm, uint8_t *out);
+
+#endif
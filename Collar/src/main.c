@@ -10,9 +10,21 @@
 #include "cJSON.h"
 #include <freertos/projdefs.h>
 #include "heartRate.h"
+#include "spo2.h"
+#include "signalQuality.h"
+#include "hrEngine.h"
+#include "ledAgc.h"
+#include "respRate.h"
 #include "esp_timer.h"
 #include <sys/time.h>
+#include <limits.h>
 #include "tinygps.h"
+#include "ubx.h"
+#include "fix_quality.h"
+#include "gps_motion.h"
+#include "pos_codec.h"
+#include "geofence.h"
+#include "esp_random.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 
@@ -21,7 +33,55 @@
 #define GPS_TXD_PIN GPIO_NUM_17
 #define GPS_RXD_PIN GPIO_NUM_16
 #define GPS_UART_BAUD_RATE 9600 // Standard GPS baud rate
+#define GPS_EVENT_QUEUE_LEN 20   // UART driver events waiting for gps_task
+#define GPS_PATTERN_QUEUE_LEN 16 // Line ends the driver remembers before the task pops them
+#define GPS_MODE_NMEA 0          // GGA/RMC text, works with any receiver
+#define GPS_MODE_UBX 1           // NAV-PVT only, needs a u-blox 7 or later
+#define GPS_UBX_RX_TIMEOUT 10    // Idle symbols that end a binary burst (UART_DATA event)
+#define GPS_MIN_SATS_DEFAULT 4   // Fix acceptance when NVS has none
+#define GPS_MAX_HDOP_DEFAULT 50  // Tenths
+#define GPS_MAX_ACC_DEFAULT 25   // m, horizontal accuracy (UBX mode)
+#define GPS_MAX_AGE_DEFAULT 5    // s
+#define GPS_TIMEOUT_DEFAULT 90   // s, the best fix so far is sent unaccepted after this
+#define GPS_STOP_POLL_MS 250     // Longest gps_task waits on the UART before checking for a stop
+#define GPS_STOP_WAIT_MS 1000    // Time given to gps_task to put the receiver in backup before deep sleep
+#define GPS_WAKE_MS 100          // Receiver start-up after the UART wake burst
+#define GPS_TTFF_HISTORY 8       // Cycles of time-to-first-fix kept in RTC memory
+#define GPS_TTFF_NONE UINT32_MAX // The search ended without an accepted fix
+#define GPS_AID_DRIFT_PPM 10000  // Internal RC slow clock keeping time in deep sleep, ~1 %
+#define GPS_AID_MAX_TACC_S 600   // Older time is not worth injecting
+#define GPS_AID_FIX_ACC_M 2000   // A herd does not wander further between cycles
+#define GPS_AID_FIX_MAX_AGE_S (24 * 3600)
+#define GPS_AID_GW_ACC_M 5000    // LoRa range around the gateway
+#define GPS_STILL_M 30           // Fixes this close are GPS noise, the animal is resting
+#define GPS_MAX_SKIP_DEFAULT 6   // Uplinks a resting animal may go without a fresh fix
+#define GEOFENCE_WATCH_S 60      // Between zone checks while the animal is near or past a boundary
+#define GEOFENCE_WATCH_MARGIN_S 10 // The last check ends this long before the next beacon
+#define ALERT_JITTER_MS 500      // Spreads the alerts of animals crossing a boundary together
 #define BUF_SIZE (1024)
+#define LORA_MAX_PAYLOAD 255     // Longest uplink the radio sends in one packet
+
+// Heart rate acquisition
+#define HR_FIFO_DEPTH 32        // MAX30102 FIFO holds 32 samples
+#define HR_INT_TIMEOUT_MS 500   // Fallback wake if a FIFO interrupt is missed
+#define HR_NOTIFY_STOP (1UL << 0) // Notification bit asking the HR task to suspend
+// Build with -D PPG_CAPTURE to stream raw samples to tools/ppg_capture
+#ifdef PPG_CAPTURE
+#define HR_WINDOW_MAX_MS 60000  // Long windows make useful datasets
+#else
+#define HR_WINDOW_MAX_MS 5000   // Cap on the heart rate window (LEDs on)
+#endif
+#define HR_CONVERGE_BEATS 5     // Consistent beat intervals needed to stop early
+#define HR_CONVERGE_TOLERANCE 0.08f // Allowed spread of those intervals around their mean
+#define HR_CONTACT_TIMEOUT_MS 60 // No proximity interrupt by then means no tissue on the sensor
+#define RESP_WINDOW_MAX_S 60     // Longest respiration window accepted from NVS
+#define HRV_WINDOW_MAX_S 60      // Longest HRV window accepted from NVS
+#define HR_SLOT_MARGIN_MS 1000   // The window ends this long before our own request is due
+#define TEMP_COMP_K_DEFAULT 0    // Ambient compensation coefficient (hundredths) when NVS has none, off until calibrated
+#define TEMP_RESOLUTION_DEFAULT 10 // DS18B20 bits when NVS has none, 0.25 C is plenty for fever alerts
+#define TEMP_POLL_MS 10          // DS18B20 read slot poll period
+#define TEMP_MAX_AGE_MS 60000    // Older wake readings are refreshed ahead of the uplink
+#define TEMP_SLOT_MARGIN_MS 200  // A refresh finishes this long before the uplink deadline
 
 int settimeofday(const struct timeval *tv, const struct timezone *tz);
 #define DEVICE_ID 30
@@ -29,9 +89,26 @@ int settimeofday(const struct timeval *tv, const struct timezone *tz);
 typedef struct
 {
     int heart_rate;
+    uint8_t spo2;
+    bool spo2_valid;
+    uint8_t signal_quality;
+    uint8_t quality_flags;
+    float perfusion;
+    float led_current; // IR LED drive chosen by the AGC (mA)
+    bool no_contact;   // The contact probe found no tissue, collar fit should be checked
+    hrv_t hrv;         // Heart rate variability of the window
+    bool hrv_valid;
+    uint8_t resp_rate; // Breaths per minute
+    uint8_t resp_confidence;
+    bool resp_valid;
     float temperature;
-    float lon;
-    float lat;
+    float ambient_temperature; // MAX30102 die temperature, the air inside the collar
+    bool ambient_valid;
+    int32_t lon; // 1e-7 degrees
+    int32_t lat;
+    uint8_t gps_quality; // fix_quality_byte(), 0 = no position
+    uint32_t gps_age;    // s, set when the last fix is sent again
+    uint8_t geofence;    // geofence_status_t of the position
 } sensor_data_t;
 
 sensor_data_t shared_data;
@@ -44,10 +121,49 @@ uint8_t my_position;
 bool before_me_saved = false;
 bool sentOnce = false;
 bool sync_status;
+uint32_t resp_window_ms = 0; // Respiration needs a longer heart rate window, 0 = off
+uint32_t hrv_window_ms = 0;  // So does HRV, 0 = off
+float temp_comp_k = TEMP_COMP_K_DEFAULT / 100.0f;
+bool zone_ref_valid = false; // Positions go out as offsets from the gateway when it is known
+int32_t zone_ref_lat, zone_ref_lon;
 
 uint16_t alloc_time;
 uint16_t time_interval;
 
+// GPS power state, kept across deep sleep
+typedef enum
+{
+    GPS_START_COLD,  // No time or position in the receiver
+    GPS_START_AIDED, // Cold, with time and position injected
+    GPS_START_HOT    // Resumed from backup with its ephemeris
+} gps_start_t;
+
+typedef struct
+{
+    uint32_t ttff_ms; // Wake to accepted fix, GPS_TTFF_NONE when the search gave up
+    uint8_t start;    // gps_start_t
+} gps_ttff_t;
+
+typedef struct
+{
+    int32_t lat; // 1e-7 degrees
+    int32_t lon;
+    int32_t alt; // cm
+    uint32_t time; // unix, 0 = none yet
+    uint8_t quality; // fix_quality_byte()
+} gps_last_fix_t;
+
+RTC_DATA_ATTR bool gps_in_backup = false;
+RTC_DATA_ATTR gps_ttff_t gps_ttff[GPS_TTFF_HISTORY];
+RTC_DATA_ATTR uint32_t gps_cycles = 0;
+RTC_DATA_ATTR gps_last_fix_t gps_last_fix = {0};
+RTC_DATA_ATTR uint32_t time_synced = 0; // unix time of the last beacon sync, 0 = clock not set
+RTC_DATA_ATTR gps_motion_t gps_motion = {0};
+RTC_DATA_ATTR geofence_table_t geofence = {0}; // id 0 until loaded from NVS or received
+RTC_DATA_ATTR uint8_t geofence_last = GEOFENCE_UNKNOWN; // Status of the last evaluated fix
+RTC_DATA_ATTR uint32_t geofence_watch_end = 0;  // unix time of the next beacon while check wakes run, 0 = none
+RTC_DATA_ATTR uint8_t slot_count = 0;           // Synced collars of the last beacon, one slot each
+
 // STATE machines
 typedef enum
 {
@@ -105,9 +221,40 @@ void setupTime();
 void configSyncTime(void *);
 void lora_peek_device_id(uint16_t *);
 void gps_task(void *);
+bool gps_read_nmea(gps_ctx_t *, uint8_t *, int, gps_fix_t *);
+bool gps_read_ubx(ubx_ctx_t *, uint8_t *, gps_fix_t *);
+void gps_configure(bool);
+void disable_gps();
+bool gps_power_wake(void);
+void gps_record_ttff(uint32_t, gps_start_t);
+bool gps_aid(void);
+bool load_gateway_position(int32_t *, int32_t *);
+bool load_geofence(geofence_table_t *);
+void save_geofence(const uint8_t *, size_t);
+void gps_reuse_last_fix(void);
+void geofence_update(int32_t, int32_t);
+void geofence_receive(void);
+void lora_send_alert(void);
+void sleep_until_beacon(uint64_t);
+void geofence_watch_task(void *);
+void settings_receive(void);
+void add_position_json(cJSON *, int32_t, int32_t);
+uint8_t load_gps_max_skip(void);
+void gps_stop(void);
+uint8_t load_gps_mode(void);
+uint32_t load_gps_criteria(fix_criteria_t *);
 bool lora_new_rety_req(void);
 void get_my_slot(uint8_t *, int, uint8_t *, uint8_t *);
 void load_before_me(uint8_t *, uint16_t *, uint16_t *, uint8_t *, bool *);
+hr_engine_type_t load_hr_engine(void);
+uint8_t load_resp_window(void);
+uint8_t load_hrv_window(void);
+uint32_t hr_slot_limit_ms(void);
+uint32_t hr_window_cap_ms(void);
+uint32_t fit_window_to_slot(uint32_t, uint32_t, const char *);
+float load_temp_comp(void);
+uint8_t load_temp_resolution(void);
+void collect_die_temperature(void);
 
 bool sync_status = false;
 
@@ -192,6 +339,11 @@ void configSyncTime(void *pvParam)
         {
             ESP_LOGI("TIME_CONFIG", "Going to deep sleep");
             get_my_slot(sync_status_mask, len_sync_status, &before_me, &my_position);
+            slot_count = 0;
+            for (int i = 0; i < len_sync_status; i++)
+            {
+                slot_count += __builtin_popcount(sync_status_mask[i]);
+            }
             ESP_LOGI("TIME CONFIG", "Device Id: %d , my position: %d and before me: %d", DEVICE_ID, (int)my_position, (int)before_me);
 
             if (!before_me_saved)
@@ -225,6 +377,7 @@ void configSyncTime(void *pvParam)
 
             if (my_position > 2)
             {
+                gps_stop();
                 esp_sleep_enable_timer_wakeup((alloc_time - 5) * (my_position - 2) * 1000000);
                 esp_deep_sleep_start();
             }
@@ -237,6 +390,11 @@ void read_sensors_task(void *pvParam)
 {
     if (!sentOnce)
     {
+        resp_window_ms = fit_window_to_slot(load_resp_window() * 1000, RESP_MIN_WINDOW_S * 1000, "Respiration");
+        hrv_window_ms = fit_window_to_slot(load_hrv_window() * 1000, HRV_MIN_WINDOW_S * 1000, "HRV");
+        zone_ref_valid = load_gateway_position(&zone_ref_lat, &zone_ref_lon);
+        temp_comp_k = load_temp_comp();
+
         // Heart Rate
         if (tasks_handle.heart_rate_handle != NULL)
         {
@@ -257,17 +415,9 @@ void read_sensors_task(void *pvParam)
             xTaskCreate(read_temp_task, "temp", 2048, NULL, 24, &tasks_handle.temp_handle);
         }
 
-        // GPS
-        if (tasks_handle.gps_handle != NULL)
-        {
-            vTaskResume(tasks_handle.gps_handle);
-        }
-        else
-        {
-            xTaskCreate(gps_task, "gps_task", 4096, NULL, 23, &tasks_handle.gps_handle);
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(5000)); // Let the sensor get the reading for 10 secs
+        // Let the sensors get their readings, the heart rate task notifies as soon
+        // as its estimate has converged and the MAX30102 is off again
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(hr_window_cap_ms()));
     }
 
     while (1)
@@ -283,7 +433,8 @@ void read_sensors_task(void *pvParam)
         // ESP_LOGI("SENSOR_MODE", "Bytes rcvd: %d", bytes_received);
         ESP_LOG_BUFFER_HEXDUMP("SENSOR_MODE", rx_buffer, bytes_received, ESP_LOG_INFO);
 
-        if (device_Id > 255 || device_Id < DEVICE_ID || bytes_received == 0)
+        // Only data requests, a geofence table must not pass for one
+        if (bytes_received <= 0 || rx_buffer[0] != 0xB0 || device_Id > 255 || device_Id < DEVICE_ID)
         {
             lora_receive();
             vTaskDelay(pdMS_TO_TICKS(10)); // Small delay to prevent CPU hogging
@@ -296,14 +447,33 @@ void read_sensors_task(void *pvParam)
         ESP_LOGI("SENSOR_MODE", "Current request Id: %d", (int)device_Id);
         ESP_LOGI("SENSOR_MODE", "Heart Rate: %d Temperature: %.2f", shared_data.heart_rate, shared_data.temperature);
 
+        if (!sentOnce && device_Id > DEVICE_ID)
+        {
+            // Our slot went by while the sensors were still reading, the
+            // receive task puts the collar to sleep on the next later request
+            ESP_LOGW("SENSOR_MODE", "Missed our slot, request is for %d", (int)device_Id);
+            xTaskCreate(lora_receive_task, "lora_rx", 4096, NULL, 24, NULL);
+            tasks_handle.read_sensor_handle = NULL;
+            vTaskDelete(NULL);
+        }
+
         if (!sentOnce)
         {
             xTaskCreate(lora_send_task, "LoRa_Task", 4 * 1024, NULL, 24, NULL);
             sentOnce = true;
+            // A collar syncs and naps before its slot, only the wake that
+            // sends counts against the skipped fixes
+            if (shared_data.gps_age > 0)
+            {
+                gps_motion_reused(&gps_motion);
+            }
 
             xTaskNotifyGive(tasks_handle.temp_handle);
-            xTaskNotifyGive(tasks_handle.heart_rate_handle);
-            xTaskNotifyGive(tasks_handle.gps_handle);
+            xTaskNotify(tasks_handle.heart_rate_handle, HR_NOTIFY_STOP, eSetBits);
+            if (tasks_handle.gps_handle != NULL)
+            {
+                xTaskNotifyGive(tasks_handle.gps_handle);
+            }
 
             vTaskDelay(pdMS_TO_TICKS(20));
             tasks_handle.read_sensor_handle = NULL;
@@ -338,9 +508,8 @@ void read_sensors_task(void *pvParam)
                         nvs_close(sync_nvs);
                     }
 
-                    esp_sleep_enable_timer_wakeup(sleep_us);
-                    vTaskDelay(pdMS_TO_TICKS(100)); // Wait 100ms
-                    esp_deep_sleep_start();
+                    gps_stop();
+                    sleep_until_beacon(sleep_us);
                 }
                 else
                 {
@@ -373,6 +542,7 @@ void setupTime(uint32_t time_stamp)
         tv.tv_usec = microseconds};
 
     settimeofday(&tv, NULL);
+    time_synced = time_stamp;
     time_t now;
     time(&now);
     ESP_LOGI("TIME", "System time set to: %s", ctime(&now));
@@ -390,159 +560,694 @@ void gps_task(void *pvParameters)
         .source_clk = UART_SCLK_APB,
     };
 
-    // Install UART driver
-    ESP_ERROR_CHECK(uart_driver_install(GPS_UART_NUM, BUF_SIZE * 2, 0, 0, NULL, 0));
+    // Install UART driver, its event queue wakes the task once per sentence
+    QueueHandle_t uart_queue;
+    ESP_ERROR_CHECK(uart_driver_install(GPS_UART_NUM, BUF_SIZE * 2, 0, GPS_EVENT_QUEUE_LEN, &uart_queue, 0));
     ESP_ERROR_CHECK(uart_param_config(GPS_UART_NUM, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(GPS_UART_NUM, GPS_TXD_PIN, GPS_RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
 
-    // Set a pattern to detect the end of a GPS sentence ('\n')
-    uart_enable_pattern_det_baud_intr(GPS_UART_NUM, '\n', 1, 9, 0, 0);
+    int64_t wake_time = esp_timer_get_time();
+    bool hot = gps_power_wake();
+    bool ubx_mode = load_gps_mode() == GPS_MODE_UBX;
+    gps_configure(ubx_mode);
+    // A receiver resumed from backup knows better than our aiding
+    gps_start_t start_type = hot ? GPS_START_HOT : gps_aid() ? GPS_START_AIDED : GPS_START_COLD;
+    if (ubx_mode)
+    {
+        // Binary frames, wake once the burst of the navigation epoch is in
+        uart_set_rx_timeout(GPS_UART_NUM, GPS_UBX_RX_TIMEOUT);
+    }
+    else
+    {
+        // Set a pattern to detect the end of a GPS sentence ('\n')
+        uart_enable_pattern_det_baud_intr(GPS_UART_NUM, '\n', 1, 9, 0, 0);
+        uart_pattern_queue_reset(GPS_UART_NUM, GPS_PATTERN_QUEUE_LEN);
+    }
 
     uint8_t *data = (uint8_t *)malloc(BUF_SIZE);
-    int newdata = 0;
-    ESP_LOGI("SENSOR_MODE", "Obtaining current location from GPS....");
-    while (1)
+    static gps_ctx_t gps;
+    static ubx_ctx_t ubx;
+    gps_ctx_init(&gps);
+    ubx_init(&ubx);
+    fix_criteria_t criteria;
+    TickType_t timeout = pdMS_TO_TICKS(load_gps_criteria(&criteria));
+    TickType_t start = xTaskGetTickCount();
+    gps_fix_t fix, best;
+    bool have_best = false;
+    bool accepted = false;
+    bool timed_out = false;
+    ESP_LOGI("SENSOR_MODE", "Obtaining current location from GPS (%s)....", ubx_mode ? "UBX" : "NMEA");
+    while (!accepted)
     {
-        // if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY))
-        // {
-        //     uart_flush(GPS_UART_NUM);
-        //     if (data)
-        //         free(data);
-        //     ESP_ERROR_CHECK(uart_driver_delete(GPS_UART_NUM));
-        //     vTaskDelete(NULL);
-        // }
-        // Read data from UART
-        int len = uart_read_bytes(GPS_UART_NUM, data, BUF_SIZE, 20 / portTICK_PERIOD_MS);
-        if (len > 0)
+        // Give up at the timeout or once the uplink is built, whatever was
+        // published by then goes out flagged as not accepted
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        timed_out = elapsed >= timeout;
+        if (timed_out || ulTaskNotifyTake(pdTRUE, 0))
+        {
+            ESP_LOGW("GPS_TASK", "No fix met the criteria, %s", have_best ? "keeping the best one" : "no position");
+            break;
+        }
+
+        // Short waits so a stop before deep sleep is seen quickly
+        TickType_t wait = timeout - elapsed;
+        if (wait > pdMS_TO_TICKS(GPS_STOP_POLL_MS))
+        {
+            wait = pdMS_TO_TICKS(GPS_STOP_POLL_MS);
+        }
+        uart_event_t event;
+        if (!xQueueReceive(uart_queue, &event, wait))
+        {
+            continue;
+        }
+
+        if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL)
+        {
+            // Partial sentences would be rejected anyway, start clean
+            uart_flush_input(GPS_UART_NUM);
+            xQueueReset(uart_queue);
+            continue;
+        }
+
+        bool have_fix = false;
+        if (ubx_mode && event.type == UART_DATA)
+        {
+            have_fix = gps_read_ubx(&ubx, data, &fix);
+        }
+        else if (!ubx_mode && event.type == UART_PATTERN_DET)
         {
-            for (int i = 0; i < len; i++) // for all chars in string
+            int pos = uart_pattern_pop_pos(GPS_UART_NUM);
+            if (pos < 0)
             {
-                // printf("%c", buf[i]);
-                if (gps_encode(data[i]))
-                    newdata = 1;
+                // The pattern queue overflowed, the line positions are lost
+                uart_flush_input(GPS_UART_NUM);
+                xQueueReset(uart_queue);
+                continue;
             }
+            have_fix = gps_read_nmea(&gps, data, pos + 1, &fix);
+        }
+        if (!have_fix)
+        {
+            continue;
+        }
+
+        // Publish as the fix improves so an early uplink still has the best one
+        accepted = fix_meets_criteria(&fix, &criteria);
+        if (accepted || !have_best || fix_better(&fix, &best))
+        {
+            best = fix;
+            have_best = true;
+            xSemaphoreTake(data_mutex, portMAX_DELAY);
+            shared_data.lon = best.longitude;
+            shared_data.lat = best.latitude;
+            shared_data.gps_quality = fix_quality_byte(&best, accepted);
+            xSemaphoreGive(data_mutex);
+            ESP_LOGI("GPS_TASK", "Fix quality 0x%02x (%s)", fix_quality_byte(&best, accepted), accepted ? "accepted" : "candidate");
+        }
+    }
 
-            if (newdata)
+    if (accepted)
+    {
+        // Kept for aiding the next cold start, an RMC-only fix has no altitude
+        int32_t alt = best.altitude == GPS_INVALID_ALTITUDE ? 0 : best.altitude;
+        gps_last_fix = (gps_last_fix_t){.lat = best.latitude, .lon = best.longitude, .alt = alt,
+                                        .time = time(NULL), .quality = fix_quality_byte(&best, true)};
+        gps_motion_add_fix(&gps_motion, best.latitude, best.longitude, GPS_STILL_M, load_gps_max_skip());
+        ESP_LOGI("GPS_TASK", "Next %d uplinks may reuse this fix", gps_motion.skip_left);
+        geofence_update(best.latitude, best.longitude);
+    }
+    else if (timed_out)
+    {
+        gps_motion_no_fix(&gps_motion);
+    }
+    gps_record_ttff(accepted ? (uint32_t)((esp_timer_get_time() - wake_time) / 1000) : GPS_TTFF_NONE, start_type);
+    disable_gps();
+    ESP_LOGI("GPS_TASK","GPS in backup");
+    uart_flush(GPS_UART_NUM);
+    ESP_ERROR_CHECK(uart_driver_delete(GPS_UART_NUM));
+    free(data);
+    tasks_handle.gps_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+// Pop exactly one line, up to and including the '\n', true once it gave a fix
+bool gps_read_nmea(gps_ctx_t *gps, uint8_t *data, int line_len, gps_fix_t *fix)
+{
+    bool newdata = false;
+    while (line_len > 0)
+    {
+        int len = uart_read_bytes(GPS_UART_NUM, data, line_len < BUF_SIZE ? line_len : BUF_SIZE, 0);
+        if (len <= 0)
+        {
+            break;
+        }
+        newdata |= gps_ctx_encode_line(gps, (const char *)data, len);
+        line_len -= len;
+    }
+    return newdata && gps_ctx_get_fix(gps, fix);
+}
+
+// Decode everything buffered, true once a NAV-PVT frame carried a fix
+bool gps_read_ubx(ubx_ctx_t *ubx, uint8_t *data, gps_fix_t *fix)
+{
+    size_t buffered = 0;
+    uart_get_buffered_data_len(GPS_UART_NUM, &buffered);
+    while (buffered > 0)
+    {
+        int len = uart_read_bytes(GPS_UART_NUM, data, buffered < BUF_SIZE ? buffered : BUF_SIZE, 0);
+        if (len <= 0)
+        {
+            break;
+        }
+        buffered -= len;
+        for (int i = 0; i < len; i++)
+        {
+            ubx_nav_pvt_t pvt;
+            if (ubx_decode(ubx, data[i]) && ubx_nav_pvt(ubx, &pvt) && ubx_pvt_has_fix(&pvt))
             {
-                float flat, flon;
-                unsigned long age;
-                gps_f_get_position(&flat, &flon, &age);
-                xSemaphoreTake(data_mutex, portMAX_DELAY);
-                shared_data.lon = flon;
-                shared_data.lat = flat;
-                xSemaphoreGive(data_mutex);
-                newdata = 0;
-                disable_gps();
-                ESP_LOGI("GPS_TASK","Disable GPS");
-                uart_flush(GPS_UART_NUM);
-                ESP_ERROR_CHECK(uart_driver_delete(GPS_UART_NUM));
-                vTaskDelete(NULL);
+                ESP_LOGI("GPS_TASK", "NAV-PVT fix %d, %d satellites, accuracy %lu mm",
+                         pvt.fix_type, pvt.num_sv, (unsigned long)pvt.h_acc);
+                ubx_pvt_to_fix(&pvt, fix);
+                return true;
             }
         }
+    }
+    return false;
+}
 
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+// Select the receiver output, UBX mode leaves NAV-PVT as the only message
+void gps_configure(bool ubx_mode)
+{
+    uint8_t frame[32];
+    size_t len = ubx_cfg_prt_uart(GPS_UART_BAUD_RATE, ubx_mode ? UBX_PROTO_UBX : UBX_PROTO_UBX | UBX_PROTO_NMEA, frame);
+    uart_write_bytes(GPS_UART_NUM, (const char *)frame, len);
+    if (ubx_mode)
+    {
+        len = ubx_cfg_msg_rate(UBX_CLASS_NAV, UBX_NAV_PVT, 1, frame);
+        uart_write_bytes(GPS_UART_NUM, (const char *)frame, len);
     }
+    uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
 }
 
-// UBX command to enable power save mode
-const uint8_t ubx_power_save[] = {
-    0xB5, 0x62, 0x06, 0x11, 0x02, 0x00, 0x08, 0x01, 0x22, 0x91};
+// Backup mode until the next wake. Ephemeris, almanac and time stay in the
+// receiver so the next search is a hot start.
+void disable_gps()
+{
+    uint8_t frame[32];
+    size_t len = ubx_rxm_pmreq_backup(0, frame);
+    uart_write_bytes(GPS_UART_NUM, (const char *)frame, len);
+    gps_in_backup = uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100)) == ESP_OK;
+}
 
-// UBX command to completely disable navigation
-const uint8_t ubx_nav_off[] = {
-    0xB5, 0x62, 0x06, 0x04, 0x24, 0x00, 0xFF, 0xFF, 0x06, 0x03,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x17, 0xC2};
+// Wake the receiver from backup with activity on its RX line, the first
+// bytes are lost while it starts. True when it had been put in backup by us.
+bool gps_power_wake(void)
+{
+    bool hot = gps_in_backup;
+    const uint8_t wake[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uart_write_bytes(GPS_UART_NUM, (const char *)wake, sizeof(wake));
+    uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
+    vTaskDelay(pdMS_TO_TICKS(GPS_WAKE_MS));
+    uart_flush_input(GPS_UART_NUM);
+    gps_in_backup = false;
+    return hot;
+}
 
-void disable_gps()
+void gps_record_ttff(uint32_t ttff_ms, gps_start_t start)
+{
+    static const char *start_name[] = {"cold", "aided", "hot"};
+    gps_ttff[gps_cycles % GPS_TTFF_HISTORY] = (gps_ttff_t){.ttff_ms = ttff_ms, .start = start};
+    gps_cycles++;
+
+    // Mean over the starts of the same kind that found a fix, comparing the
+    // kinds shows what backup and aiding buy
+    uint32_t sum = 0;
+    int count = 0;
+    int kept = gps_cycles < GPS_TTFF_HISTORY ? gps_cycles : GPS_TTFF_HISTORY;
+    for (int i = 0; i < kept; i++)
+    {
+        if (gps_ttff[i].start == start && gps_ttff[i].ttff_ms != GPS_TTFF_NONE)
+        {
+            sum += gps_ttff[i].ttff_ms;
+            count++;
+        }
+    }
+    if (ttff_ms == GPS_TTFF_NONE)
+    {
+        ESP_LOGW("GPS_TASK", "No fix this cycle (%s start)", start_name[start]);
+    }
+    else
+    {
+        ESP_LOGI("GPS_TASK", "TTFF %lu ms (%s start)", (unsigned long)ttff_ms, start_name[start]);
+    }
+    if (count > 0)
+    {
+        ESP_LOGI("GPS_TASK", "Mean %s start TTFF over the last %d fixes: %lu ms", start_name[start], count, (unsigned long)(sum / count));
+    }
+}
+
+// Inject the time kept since the last beacon and a rough position, the last
+// fix or else the gateway's, with UBX-MGA-INI. True when anything was sent.
+bool gps_aid(void)
 {
-    // Send power save command
-    uart_write_bytes(GPS_UART_NUM, (const char *)ubx_power_save, sizeof(ubx_power_save));
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+    uint8_t frame[40];
+    size_t len;
+    bool aided = false;
+    uint32_t now = time(NULL);
 
-    // Optional: Also send navigation off command for more complete shutdown
-    // uart_write_bytes(GPS_UART_NUM, (const char *)ubx_nav_off, sizeof(ubx_nav_off));
-    // vTaskDelay(100 / portTICK_PERIOD_MS);
+    if (time_synced != 0 && now >= time_synced)
+    {
+        // The slow clock drifts while the collar sleeps
+        uint32_t acc_s = 1 + (uint32_t)((uint64_t)(now - time_synced) * GPS_AID_DRIFT_PPM / 1000000);
+        if (acc_s <= GPS_AID_MAX_TACC_S)
+        {
+            len = ubx_mga_ini_time_utc(now, acc_s, frame);
+            uart_write_bytes(GPS_UART_NUM, (const char *)frame, len);
+            ESP_LOGI("GPS_TASK", "Aiding time %lu +- %lu s", (unsigned long)now, (unsigned long)acc_s);
+            aided = true;
+        }
+    }
 
-    // Flush the UART to ensure commands are sent
-    uart_flush(GPS_UART_NUM);
+    int32_t lat, lon;
+    if (gps_last_fix.time != 0 && now >= gps_last_fix.time && now - gps_last_fix.time <= GPS_AID_FIX_MAX_AGE_S)
+    {
+        len = ubx_mga_ini_pos_llh(gps_last_fix.lat, gps_last_fix.lon, gps_last_fix.alt, GPS_AID_FIX_ACC_M * 100UL, frame);
+        uart_write_bytes(GPS_UART_NUM, (const char *)frame, len);
+        ESP_LOGI("GPS_TASK", "Aiding with the last fix");
+        aided = true;
+    }
+    else if (load_gateway_position(&lat, &lon))
+    {
+        // The gateway altitude is unknown, the accuracy covers it
+        len = ubx_mga_ini_pos_llh(lat, lon, 0, GPS_AID_GW_ACC_M * 100UL, frame);
+        uart_write_bytes(GPS_UART_NUM, (const char *)frame, len);
+        ESP_LOGI("GPS_TASK", "Aiding with the gateway position");
+        aided = true;
+    }
+
+    uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
+    return aided;
+}
+
+// Publish the last accepted fix with its age instead of powering the GPS up
+void gps_reuse_last_fix(void)
+{
+    uint32_t now = time(NULL);
+    uint32_t age = now > gps_last_fix.time ? now - gps_last_fix.time : 1;
+    xSemaphoreTake(data_mutex, portMAX_DELAY);
+    shared_data.lat = gps_last_fix.lat;
+    shared_data.lon = gps_last_fix.lon;
+    shared_data.gps_quality = gps_last_fix.quality;
+    shared_data.gps_age = age;
+    xSemaphoreGive(data_mutex);
+    ESP_LOGI("GPS_TASK", "Resting, reusing the fix from %lu s ago (%d more uplinks)", (unsigned long)age, gps_motion.skip_left);
+    // The table may have changed since the fix was taken
+    geofence_update(gps_last_fix.lat, gps_last_fix.lon);
+}
+
+// Ask gps_task to finish and put the receiver in backup, call before deep sleep
+void gps_stop(void)
+{
+    TaskHandle_t gps = tasks_handle.gps_handle;
+    if (gps == NULL)
+    {
+        return;
+    }
+    xTaskNotifyGive(gps);
+    for (int i = 0; i < GPS_STOP_WAIT_MS / 10 && tasks_handle.gps_handle != NULL; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+// Zone status of an accepted fix, it goes out with the uplink in our slot or
+// as an alert from a check wake (geofence_watch_task)
+void geofence_update(int32_t lat, int32_t lon)
+{
+    geofence_status_t status = geofence_check(&geofence, lat, lon);
+    if (status == GEOFENCE_UNKNOWN)
+    {
+        return;
+    }
+    xSemaphoreTake(data_mutex, portMAX_DELAY);
+    shared_data.geofence = status;
+    xSemaphoreGive(data_mutex);
+    geofence_last = status;
+    if (status == GEOFENCE_DANGER)
+    {
+        ESP_LOGW("GEOFENCE", "In a danger zone or outside every safe zone");
+    }
+}
+
+// Take a geofence table broadcast by the gateway, kept in NVS when it changed
+void geofence_receive(void)
+{
+    uint8_t rx_buffer[256];
+    int bytes_received = lora_receive_packet(rx_buffer, sizeof(rx_buffer));
+    if (bytes_received <= 1 || rx_buffer[0] != 0xC0)
+    {
+        return;
+    }
+
+    geofence_table_t table;
+    if (!geofence_parse(&rx_buffer[1], bytes_received - 1, &table))
+    {
+        ESP_LOGW("GEOFENCE", "Malformed table of %d bytes", bytes_received);
+        return;
+    }
+    if (table.id == geofence.id)
+    {
+        return;
+    }
+    geofence = table;
+    geofence_last = GEOFENCE_UNKNOWN;
+    save_geofence(&rx_buffer[1], bytes_received - 1);
+    ESP_LOGI("GEOFENCE", "Table %08lx: %d zones, warning buffer %d m", (unsigned long)table.id, table.count, table.buffer_m);
+}
+
+// Settings the gateway may change, indexed by their id in the 0xD0 frame.
+// All are u8 keys of "sensor_cfg", each loader checks the range.
+static const char *const sensor_cfg_keys[] = {
+    "hr_engine",
+    "resp_window",
+    "temp_k",
+    "temp_res",
+    "gps_mode",
+    "gps_min_sats",
+    "gps_max_hdop",
+    "gps_max_acc",
+    "gps_max_age",
+    "gps_max_skip",
+    "hrv_window",
+};
+
+// Take settings sent by the gateway: 0xD0, device id (u16, 0xFFFF = every
+// collar), then setting id and value pairs. Stored in NVS, used from the
+// next wake on.
+void settings_receive(void)
+{
+    uint8_t rx_buffer[256];
+    int bytes_received = lora_receive_packet(rx_buffer, sizeof(rx_buffer));
+    if (bytes_received < 3 || rx_buffer[0] != 0xD0)
+    {
+        return;
+    }
+    uint16_t target = rx_buffer[1] | rx_buffer[2] << 8;
+    if (target != DEVICE_ID && target != 0xFFFF)
+    {
+        return;
+    }
+
+    nvs_handle_t cfg_nvs;
+    if (nvs_open("sensor_cfg", NVS_READWRITE, &cfg_nvs) != ESP_OK)
+    {
+        ESP_LOGE("NVS", "Failed to open sensor_cfg for the settings");
+        return;
+    }
+    // The gateway repeats the frame, only changed values are written
+    bool changed = false;
+    for (int i = 3; i + 1 < bytes_received; i += 2)
+    {
+        uint8_t id = rx_buffer[i];
+        uint8_t value = rx_buffer[i + 1];
+        if (id >= sizeof(sensor_cfg_keys) / sizeof(sensor_cfg_keys[0]))
+        {
+            ESP_LOGW("NVS", "Unknown setting %d", id);
+            continue;
+        }
+        uint8_t current;
+        if (nvs_get_u8(cfg_nvs, sensor_cfg_keys[id], &current) == ESP_OK && current == value)
+        {
+            continue;
+        }
+        if (nvs_set_u8(cfg_nvs, sensor_cfg_keys[id], value) == ESP_OK)
+        {
+            changed = true;
+            ESP_LOGI("NVS", "Setting %s = %d", sensor_cfg_keys[id], value);
+        }
+    }
+    if (changed)
+    {
+        nvs_commit(cfg_nvs);
+    }
+    nvs_close(cfg_nvs);
 }
 
 void read_heartrate_task(void *pvParameters)
 {
     max30102Sensor_init();
+    // The die temperature converts (~29 ms) while the window runs
+    max30102Sensor_start_die_temperature();
 
     ESP_LOGI("SENSOR_MODE", "Reading Heart Rate");
-    // Config
-    const uint8_t RATE_SIZE = 4;          // Moving average window
-    const uint16_t SAMPLES_PER_READ = 15; // FIFO size
-    uint8_t rates[RATE_SIZE];
-    uint8_t rateSpot = 0;
-    int64_t lastBeat = 0;
-    int beatAvg = 0, last_beatAvg = 0;
-
-    // Buffers
-    uint16_t red[SAMPLES_PER_READ], ir[SAMPLES_PER_READ];
-    int64_t sample_times[SAMPLES_PER_READ];
+    // Heart rate estimator selected in NVS (zero crossing unless configured)
+    static hr_engine_t engine; // Keeps the autocorrelation window off the task stack
+    hrEngineInit(&engine, load_hr_engine());
+    int last_hr = 0;
+    uint8_t last_spo2 = 0;
+    bool last_spo2_valid = false;
+
+    // SpO2 is estimated over the same batches the beat detector sees
+    spo2_t spo2;
+    spo2Reset(&spo2);
+
+    // Respiration from the IR baseline, only when a long enough window is configured
+    static resp_rate_t resp; // Keeps the baseline buffer off the task stack
+    respReset(&resp);
+
+    // Signal quality of the window, gates the reported heart rate
+    signal_quality_t quality;
+    sqiReset(&quality);
+    uint8_t last_sqi = 0, last_flags = 0;
+
+    // LED currents start from the last good setting and follow the DC level
+    uint8_t red_pa, ir_pa;
+    max30102Sensor_get_led_current(&red_pa, &ir_pa);
+    led_agc_t agc_red, agc_ir;
+    agcInit(&agc_red, red_pa);
+    agcInit(&agc_ir, ir_pa);
+    xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+    shared_data.led_current = AGC_PA_TO_MA(agc_ir.pa);
+    xSemaphoreGive(data_mutex);
+
+    // The window ends early once the estimate converges, or at the cap
+    int64_t window_start = esp_timer_get_time();
+    bool window_done = false;
+
+#ifdef PPG_CAPTURE
+    printf("PPG_START\n");
+#endif
+
+    // Contact probe, there is no point in running the LEDs for a whole window
+    // when the sensor is not on the skin
+    bool contact = max30102Sensor_probe_contact(HR_CONTACT_TIMEOUT_MS);
+    xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+    shared_data.no_contact = !contact;
+    if (!contact)
+    {
+        shared_data.heart_rate = 0;
+        shared_data.spo2_valid = false;
+        shared_data.signal_quality = 0;
+        shared_data.quality_flags = SQI_FLAG_NO_CONTACT;
+    }
+    xSemaphoreGive(data_mutex);
+    if (!contact)
+    {
+        collect_die_temperature();
+        max30102Sensor_shutdown();
+        window_done = true;
+#ifdef PPG_CAPTURE
+        printf("PPG_END\n"); // An empty window, the recorder must not wait for samples
+#endif
+        ESP_LOGW("HEART_RATE", "No skin contact after %d ms, MAX30102 off", HR_CONTACT_TIMEOUT_MS);
+        if (tasks_handle.read_sensor_handle != NULL)
+        {
+            xTaskNotifyGive(tasks_handle.read_sensor_handle);
+        }
+    }
+
+    // Buffers (a burst read never returns more than the whole FIFO)
+    uint16_t red[HR_FIFO_DEPTH], ir[HR_FIFO_DEPTH];
 
     while (1)
     {
-        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)))
+        // 1. Sleep until the FIFO almost full interrupt (or a stop request)
+        uint32_t events = 0;
+        xTaskNotifyWait(0, ULONG_MAX, &events, pdMS_TO_TICKS(HR_INT_TIMEOUT_MS));
+        if (events & HR_NOTIFY_STOP)
         {
             // ESP_LOGI("SENSOR_MODE", "Suspend Heart Rate Sensor");
             vTaskSuspend(NULL);
+            continue;
+        }
+        if (window_done)
+        {
+            continue; // MAX30102 is already shut down, wait for the stop request
         }
-        // 1. Read FIFO (15 samples @ 400Hz = 37.5ms of data)
-        readRaw(red, ir);
-        int64_t batch_start = esp_timer_get_time(); // us (micro)
 
-        // 2. Process each sample with timestamp
-        for (size_t i = 0; i < SAMPLES_PER_READ; i++)
+        // On a timeout the INT edge may have been missed, servicing the status
+        // register releases the pin so the next edge is seen again
+        max30102Sensor_service_interrupt();
+        size_t count = readFifo(red, ir, HR_FIFO_DEPTH);
+        int64_t batch_end = esp_timer_get_time(); // us (micro)
+
+#ifdef PPG_CAPTURE
+        for (size_t i = 0; i < count; i++)
         {
-            sample_times[i] = batch_start + (i * 2500); // 2.5ms spacing (100Hz)
+            printf("PPG,%u,%u\n", red[i], ir[i]);
+        }
+#endif
 
-            if (checkForBeat(ir[i]))
+        // 2. Process each sample with timestamp, the newest sample was taken just now
+        for (size_t i = 0; i < count; i++)
+        {
+            int64_t sample_time = batch_end - (int64_t)(count - 1 - i) * MAX30102_SAMPLE_PERIOD_US;
+            hrEngineAddSample(&engine, ir[i], sample_time);
+            if (resp_window_ms > 0)
             {
-                int64_t delta = (sample_times[i] - lastBeat) / 1000; // ms
-                lastBeat = sample_times[i];
-
-                if (delta > 0)
-                {                                // Prevent division by zero
-                    float bpm = 60000.0 / delta; // Correct BPM calculation
-                    if (bpm > 20 && bpm < 255)
-                    {
-                        rates[rateSpot++] = (uint8_t)bpm;
-                        rateSpot %= RATE_SIZE;
-
-                        // Update average
-                        beatAvg = 0;
-                        for (uint8_t x = 0; x < RATE_SIZE; x++)
-                            beatAvg += rates[x];
-                        beatAvg /= RATE_SIZE;
-                    }
-                }
+                respAddSample(&resp, ir[i]);
             }
+        }
+        hrEngineUpdate(&engine);
+        uint8_t hr_confidence;
+        int hr = hrEngineBpm(&engine, &hr_confidence);
 
-            if (ir[i] < 500)
+        // 3. Window quality, the heart rate is only reported when it can be trusted.
+        // Batches taken while the LEDs settle after a current change are left out.
+        if (agc_red.settle == 0 && agc_ir.settle == 0)
+        {
+            spo2AddSamples(&spo2, red, ir, count);
+            sqiAddSamples(&quality, ir, count);
+        }
+        // Right after a current change there is nothing to judge, the last
+        // published quality stands until clean samples come in again
+        uint8_t flags = last_flags;
+        float perfusion = 0;
+        uint8_t sqi = last_sqi;
+        int reported_hr = last_hr;
+        if (quality.samples > 0)
+        {
+            sqi = sqiEvaluate(&quality, &spo2.ir, hr, hr_confidence, &flags, &perfusion);
+            reported_hr = hr;
+            if (sqi < SQI_MIN_FOR_HR)
             {
-                beatAvg = 0;
+                // A withheld rate always says why, a bare 0 reads as no pulse
+                reported_hr = 0;
+                flags |= SQI_FLAG_LOW_QUALITY;
             }
         }
 
-        // 3. Thread-safe data update (only if changed)
-        if (beatAvg != last_beatAvg)
+        // 4. Thread-safe data update (only if changed)
+        if (reported_hr != last_hr || sqi != last_sqi || flags != last_flags)
         {
             xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
-            shared_data.heart_rate = beatAvg;
+            shared_data.heart_rate = reported_hr;
+            shared_data.signal_quality = sqi;
+            shared_data.quality_flags = flags;
+            shared_data.perfusion = perfusion;
             xSemaphoreGive(data_mutex);
-            ESP_LOGI("HEART_RATE", "Heart Rate %d", beatAvg);
-            last_beatAvg = beatAvg;
+            ESP_LOGI("HEART_RATE", "Heart Rate %d (raw %d, confidence %d) SQI %d flags 0x%02x PI %.2f%%", reported_hr, hr, hr_confidence, sqi, flags, perfusion);
+            last_hr = reported_hr;
+            last_sqi = sqi;
+            last_flags = flags;
         }
-        // printf("Heart Rate: %d Temp: %.2f\n", shared_data.heart_rate, shared_data.temperature);
 
-        // 4. Delay until next batch (adjust for your actual FIFO refill rate)
-        vTaskDelay(37.5 / portTICK_PERIOD_MS); // ~100Hz effective
+        // Keep the DC level of both LEDs in band, the AC/DC statistics
+        // gathered at the old current no longer apply after a change
+        bool red_changed = agcUpdate(&agc_red, red, count);
+        bool ir_changed = agcUpdate(&agc_ir, ir, count);
+        if (red_changed || ir_changed)
+        {
+            max30102Sensor_set_led_current(agc_red.pa, agc_ir.pa);
+            spo2Reset(&spo2);
+            sqiReset(&quality);
+            respReset(&resp); // A current step would look like a breath
+            xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+            shared_data.led_current = AGC_PA_TO_MA(agc_ir.pa);
+            xSemaphoreGive(data_mutex);
+            ESP_LOGI("HEART_RATE", "LED current red %.1f mA IR %.1f mA", AGC_PA_TO_MA(agc_red.pa), AGC_PA_TO_MA(agc_ir.pa));
+        }
+
+        uint8_t spo2_value;
+        bool spo2_valid = spo2Estimate(&spo2, &spo2_value);
+        if (spo2_value != last_spo2 || spo2_valid != last_spo2_valid)
+        {
+            xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+            shared_data.spo2 = spo2_value;
+            shared_data.spo2_valid = spo2_valid;
+            xSemaphoreGive(data_mutex);
+            ESP_LOGI("HEART_RATE", "SpO2 %d%% (%s)", spo2_value, spo2_valid ? "valid" : "low quality");
+            last_spo2 = spo2_value;
+            last_spo2_valid = spo2_valid;
+        }
+
+        // 5. Stop the window as soon as the estimate converged (or the cap is hit),
+        // a respiration or HRV window keeps it open until enough breaths or
+        // beats were seen.
+        // SpO2 needs its own run of clean samples after every AGC step, a
+        // window that cannot give one stops at the cap.
+        int64_t window_ms = (esp_timer_get_time() - window_start) / 1000;
+        bool converged = sqi >= SQI_MIN_FOR_HR && hrEngineConverged(&engine, HR_CONVERGE_BEATS, HR_CONVERGE_TOLERANCE) &&
+                         spo2_valid && window_ms >= resp_window_ms && window_ms >= hrv_window_ms;
+#ifdef PPG_CAPTURE
+        converged = false; // Record the whole window
+#endif
+        if (converged || window_ms >= hr_window_cap_ms())
+        {
+            collect_die_temperature();
+            max30102Sensor_shutdown();
+            window_done = true;
+            if (quality.samples == 0)
+            {
+                // Capped while settling, the quality says nothing about the pulse
+                xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+                shared_data.quality_flags |= SQI_FLAG_SETTLING;
+                xSemaphoreGive(data_mutex);
+            }
+            max30102Sensor_save_led_current(agc_red.good_pa ? agc_red.good_pa : agc_red.pa,
+                                            agc_ir.good_pa ? agc_ir.good_pa : agc_ir.pa);
+
+            // HRV from the beat intervals of the whole window, only when one
+            // was asked for and ran its full length (a window stopped at the
+            // first few agreeing beats says nothing about their variability)
+            // and the signal was good enough to trust the beats
+            hrv_t hrv;
+            bool hrv_valid = hrv_window_ms > 0 && window_ms >= hrv_window_ms && sqi >= SQI_MIN_FOR_HR &&
+                             ibiHrv(&engine.intervals, &hrv);
+            xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+            shared_data.hrv = hrv;
+            shared_data.hrv_valid = hrv_valid;
+            xSemaphoreGive(data_mutex);
+            if (hrv_valid)
+            {
+                ESP_LOGI("HEART_RATE", "HRV RMSSD %d ms SDNN %d ms pNN50 %d%% (%d intervals)", hrv.rmssd_ms, hrv.sdnn_ms, hrv.pnn50, hrv.intervals);
+            }
+
+            // Respiration over the same window, the heart rate sets the
+            // averaging that removes the cardiac pulse from the baseline
+            float brpm = 0;
+            uint8_t resp_confidence = 0;
+            bool resp_valid = resp_window_ms > 0 && sqi >= SQI_MIN_FOR_HR &&
+                              respEstimate(&resp, hr, &brpm, &resp_confidence);
+            xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+            shared_data.resp_rate = (uint8_t)(brpm + 0.5f);
+            shared_data.resp_confidence = resp_confidence;
+            shared_data.resp_valid = resp_valid;
+            xSemaphoreGive(data_mutex);
+            if (resp_valid)
+            {
+                ESP_LOGI("HEART_RATE", "Respiration %.1f breaths/min (confidence %d)", brpm, resp_confidence);
+            }
+#ifdef PPG_CAPTURE
+            printf("PPG_END\n");
+#endif
+            ESP_LOGI("HEART_RATE", "Window %s after %d ms, MAX30102 off", converged ? "converged" : "capped", (int)window_ms);
+            if (tasks_handle.read_sensor_handle != NULL)
+            {
+                xTaskNotifyGive(tasks_handle.read_sensor_handle);
+            }
+        }
+        // printf("Heart Rate: %d Temp: %.2f\n", shared_data.heart_rate, shared_data.temperature);
     }
 }
 
@@ -569,6 +1274,14 @@ void lora_receive_task(void *pvParameters)
                 vTaskDelete(NULL);
                 break;
 
+            case 0xC0: // Geofence table
+                geofence_receive();
+                break;
+
+            case 0xD0: // Sensor settings
+                settings_receive();
+                break;
+
             case 0xB0: // Read sensor task
             {
                 if (!sync_status)
@@ -612,9 +1325,8 @@ void lora_receive_task(void *pvParameters)
                         }
                         nvs_close(sync_nvs);
                     }
-                    esp_sleep_enable_timer_wakeup(sleep_us);
-                    vTaskDelay(pdMS_TO_TICKS(100)); // Wait 100ms
-                    esp_deep_sleep_start();
+                    gps_stop();
+                    sleep_until_beacon(sleep_us);
                 }
             }
             break;
@@ -635,8 +1347,8 @@ void lora_send_task(void *pvParameters)
     createJsonDoc(&msg);
     if (msg != NULL)
     {
-        // Check LoRa packet size limit (e.g., 255 bytes)
-        if (strlen(msg) <= 255)
+        // createJsonDoc keeps within the packet size, this only guards it
+        if (strlen(msg) <= LORA_MAX_PAYLOAD)
         {
             lora_send_packet((uint8_t *)msg, strlen(msg));
             ESP_LOGI("LORA_TX_MODE", "Sent: %s (len=%d)", msg, strlen(msg));
@@ -659,31 +1371,160 @@ void lora_send_task(void *pvParameters)
     vTaskDelete(NULL);
 }
 
+// Out of schedule uplink of a zone change, only the position and the zone
+// status. It goes out from a check wake after the last slot of the cycle,
+// the gateway listens in between.
+void lora_send_alert(void)
+{
+    xSemaphoreTake(data_mutex, portMAX_DELAY);
+    int32_t lat = shared_data.lat;
+    int32_t lon = shared_data.lon;
+    uint8_t gps_quality = shared_data.gps_quality;
+    uint8_t status = shared_data.geofence;
+    xSemaphoreGive(data_mutex);
+
+    char dev_id[5], gq_str[5], gf_str[4], gi_str[9];
+    snprintf(dev_id, sizeof(dev_id), "%d", DEVICE_ID);
+    snprintf(gq_str, sizeof(gq_str), "%d", gps_quality);
+    snprintf(gf_str, sizeof(gf_str), "%d", status);
+    snprintf(gi_str, sizeof(gi_str), "%08lx", (unsigned long)geofence.id);
+    cJSON *doc = cJSON_CreateObject();
+    cJSON_AddStringToObject(doc, "i", dev_id);
+    cJSON_AddStringToObject(doc, "pr", "1");
+    cJSON_AddStringToObject(doc, "gf", gf_str);
+    cJSON_AddStringToObject(doc, "gi", gi_str);
+    cJSON_AddStringToObject(doc, "gq", gq_str);
+    add_position_json(doc, lat, lon);
+    char *msg = cJSON_PrintUnformatted(doc);
+    cJSON_Delete(doc);
+
+    if (msg != NULL)
+    {
+        vTaskDelay(pdMS_TO_TICKS(esp_random() % ALERT_JITTER_MS));
+        lora_send_packet((uint8_t *)msg, strlen(msg));
+        ESP_LOGI("LORA_TX_MODE", "Alert sent: %s", msg);
+        free(msg);
+    }
+}
+
+// Deep sleep until the next beacon, sleep_us away. While the animal is near
+// or past a boundary the collar first wakes in the gap after the last slot
+// of the cycle, and every GEOFENCE_WATCH_S after that, to check the zone
+// with the GPS alone (geofence_watch_task).
+void sleep_until_beacon(uint64_t sleep_us)
+{
+    geofence_watch_end = 0;
+    if (time_synced != 0 && slot_count >= my_position &&
+        (geofence_last == GEOFENCE_WARNING || geofence_last == GEOFENCE_DANGER))
+    {
+        // One slot to spare for the gateway's retries
+        uint64_t gap_us = (uint64_t)(slot_count - my_position + 1) * alloc_time * 1000000ULL;
+        if (gap_us + GEOFENCE_WATCH_MARGIN_S * 1000000ULL < sleep_us)
+        {
+            geofence_watch_end = time(NULL) + sleep_us / 1000000;
+            ESP_LOGI("GEOFENCE", "Zone check in %d s", (int)(gap_us / 1000000));
+            sleep_us = gap_us;
+        }
+    }
+    esp_sleep_enable_timer_wakeup(sleep_us);
+    vTaskDelay(pdMS_TO_TICKS(100)); // Wait 100ms
+    esp_deep_sleep_start();
+}
+
+// Check wake between cycles: a fix checked against the zones, an alert when
+// the animal crossed into or out of danger since the last check, then sleep
+// until the next check or the beacon
+void geofence_watch_task(void *pvParameters)
+{
+    uint8_t previous = geofence_last;
+    uint32_t deadline = geofence_watch_end - GEOFENCE_WATCH_MARGIN_S;
+
+    // gps_task ends on an accepted fix or at its timeout, the beacon does not wait
+    while (tasks_handle.gps_handle != NULL && (uint32_t)time(NULL) < deadline)
+    {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    gps_stop();
+
+    uint8_t status = geofence_last;
+    if (status != previous && (status == GEOFENCE_DANGER || previous == GEOFENCE_DANGER))
+    {
+        lora_send_alert();
+    }
+
+    uint32_t now = time(NULL);
+    uint32_t sleep_s = geofence_watch_end > now ? geofence_watch_end - now : 1;
+    if ((status == GEOFENCE_WARNING || status == GEOFENCE_DANGER) &&
+        sleep_s > GEOFENCE_WATCH_S + GEOFENCE_WATCH_MARGIN_S)
+    {
+        sleep_s = GEOFENCE_WATCH_S;
+    }
+    else
+    {
+        geofence_watch_end = 0;
+    }
+    ESP_LOGI("GEOFENCE", "Zone check done, sleeping for %lu s", (unsigned long)sleep_s);
+    esp_sleep_enable_timer_wakeup(sleep_s * 1000000ULL);
+    vTaskDelay(pdMS_TO_TICKS(100)); // Wait 100ms
+    esp_deep_sleep_start();
+}
+
 void read_temp_task(void *pvParameter)
 {
-    // Initialize the temperature sensor
-    ds18b20_init_sensor();
     ESP_LOGI("SENSOR_MODE", "Reading Temperature sensor");
-    float temperature = 0;
-    shared_data.temperature = 0;
     while (true)
     {
-        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)))
+        // The uplink goes out when the heart rate window closes at the latest.
+        // A conversion started at wake that would be stale by then is replaced
+        // by one timed to finish just ahead of the uplink.
+        uint32_t deadline_ms = hr_window_cap_ms();
+        uint32_t age_ms = temperatureAgeMs();
+        bool stop = false;
+        float temp;
+
+        // Publish the wake reading if it is already there, a refresh replaces it
+        if (collectTemperature(&temp) == ESP_OK)
         {
-            // ESP_LOGI("SENSOR_MODE","Suspend from Temperature sensor");
-            vTaskSuspend(NULL);
+            xSemaphoreTake(data_mutex, portMAX_DELAY);
+            shared_data.temperature = temp;
+            xSemaphoreGive(data_mutex);
         }
-        float temp;
-        getTemperature(&temp);
-        if (temp != temperature)
+
+        if (age_ms == UINT32_MAX || age_ms + deadline_ms > TEMP_MAX_AGE_MS)
+        {
+            uint32_t lead_ms = temperatureConversionMs() + TEMP_SLOT_MARGIN_MS;
+            if (deadline_ms > lead_ms)
+            {
+                stop = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(deadline_ms - lead_ms));
+            }
+            if (!stop)
+            {
+                startTemperature();
+            }
+        }
+
+        // Wait for the pending conversion, the task sleeps between checks
+        esp_err_t res = ESP_ERR_INVALID_STATE;
+        while (!stop && (res = collectTemperature(&temp)) == ESP_ERR_NOT_FINISHED)
+        {
+            stop = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TEMP_POLL_MS));
+        }
+
+        if (!stop && res == ESP_OK)
         {
             xSemaphoreTake(data_mutex, portMAX_DELAY);
             shared_data.temperature = temp;
             xSemaphoreGive(data_mutex);
-            temperature = temp;
-            // ESP_LOGI("SENSOR_MODE","Temperature: %0.2f ",temp);
+            ESP_LOGI("SENSOR_MODE", "Temperature: %0.2f", temp);
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
+
+        // One reading per wake, wait for the stop request
+        if (!stop)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        // ESP_LOGI("SENSOR_MODE","Suspend from Temperature sensor");
+        vTaskSuspend(NULL);
     }
 }
 
@@ -731,6 +1572,38 @@ void app_main(void *pvParamaters)
         return;
     }
 
+    // A timer wake with zone checks pending falls between cycles, only the
+    // GPS and the radio are needed (geofence_watch_task)
+    bool check_wake = geofence_watch_end != 0 && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+    if (!check_wake)
+    {
+        geofence_watch_end = 0;
+
+        // Start the DS18B20 conversion right at wake, it runs while the collar
+        // waits for its slot and is collected by read_temp_task
+        ds18b20_init_sensor();
+        setTemperatureResolution(load_temp_resolution());
+        startTemperature();
+    }
+
+    // A collar that lost power gets its geofence table back from NVS
+    if (geofence.id == 0 && load_geofence(&geofence))
+    {
+        ESP_LOGI("GEOFENCE", "Table %08lx from NVS: %d zones", (unsigned long)geofence.id, geofence.count);
+    }
+
+    // The GPS searches from wake while the collar waits for its slot, unless
+    // the animal has been resting and the last fix still stands. A zone check
+    // always takes a fresh fix.
+    if (!check_wake && gps_last_fix.time != 0 && gps_motion_skip(&gps_motion, load_gps_max_skip()))
+    {
+        gps_reuse_last_fix();
+    }
+    else
+    {
+        xTaskCreate(gps_task, "gps_task", 4096, NULL, 23, &tasks_handle.gps_handle);
+    }
+
     // Initialize Lora
     ESP_LOGI("LORA", "Initializing LoRa...");
 
@@ -747,7 +1620,14 @@ void app_main(void *pvParamaters)
     // xTaskCreate(read_temp_task, "ds18b20_task", 4096, NULL, 2, NULL);
     // xTaskCreate(read_heartrate_task, "HeartRate_Task", 4096, NULL, 2, NULL);
     // xTaskCreate(lora_send_task, "LoRa_Task", 4096, NULL, 1, NULL);
-    xTaskCreate(lora_receive_task, "lora_rx", 4096, NULL, 24, NULL);
+    if (check_wake)
+    {
+        xTaskCreate(geofence_watch_task, "gf_watch", 4096, NULL, 24, NULL);
+    }
+    else
+    {
+        xTaskCreate(lora_receive_task, "lora_rx", 4096, NULL, 24, NULL);
+    }
     // xTaskCreate(gps_task, "gps_task", 4096, NULL, 23, tasks_handle.gps_handle);
 
     ESP_LOGI("ESP32", "Tasks created, system running");
@@ -766,37 +1646,185 @@ void createJsonDoc(char **jsonStr)
     int id = DEVICE_ID;
     xSemaphoreTake(data_mutex, portMAX_DELAY);
     float temp = shared_data.temperature;
+    float ambient = shared_data.ambient_temperature;
+    bool ambient_valid = shared_data.ambient_valid;
     int hr = shared_data.heart_rate;
-    float lat = shared_data.lat;
-    float lon = shared_data.lon;
+    int spo2 = shared_data.spo2;
+    bool spo2_valid = shared_data.spo2_valid;
+    int sqi = shared_data.signal_quality;
+    int quality_flags = shared_data.quality_flags;
+    float perfusion = shared_data.perfusion;
+    float led_current = shared_data.led_current;
+    bool no_contact = shared_data.no_contact;
+    hrv_t hrv = shared_data.hrv;
+    bool hrv_valid = shared_data.hrv_valid;
+    int resp_rate = shared_data.resp_rate;
+    int resp_confidence = shared_data.resp_confidence;
+    bool resp_valid = shared_data.resp_valid;
+    int32_t lat = shared_data.lat;
+    int32_t lon = shared_data.lon;
+    uint8_t gps_quality = shared_data.gps_quality;
+    uint32_t gps_age = shared_data.gps_age;
+    uint8_t geofence_status = shared_data.geofence;
     xSemaphoreGive(data_mutex);
 
+    // Core estimate from the air temperature, sent next to the raw probe
+    // reading the backend thresholds are set on. Only with a calibrated k.
+    bool temp_comp_valid = ambient_valid && temp != 0 && temp_comp_k != 0;
+    float temp_comp = 0;
+    if (temp_comp_valid)
+    {
+        temp_comp = compensateTemperature(temp, ambient, temp_comp_k);
+        ESP_LOGI("LORA_TX_MODE", "Temp %0.2f compensated to %0.2f (ambient %0.2f)", temp, temp_comp, ambient);
+    }
+
     ESP_LOGI("LORA_TX_MODE", "Heart Rate: %d Temp: %0.2f", hr, temp);
     // Prepare Json Doc
-    char temp_str[10], lat_str[10], lon_str[10], hr_str[10], dev_id[5];
+    char temp_str[10], hr_str[10], spo2_str[5], sqi_str[5], qf_str[5], pi_str[8], lc_str[6], rm_str[6], sd_str[6], pn_str[5], rr_str[5], rc_str[5], ta_str[10], tc_str[10], gq_str[5], ga_str[8], gf_str[4], gi_str[9], dev_id[5];
     cJSON *doc = cJSON_CreateObject();
 
     // Format to 2 decimal places as strings
     snprintf(dev_id, sizeof(dev_id), "%d", id);
     snprintf(temp_str, sizeof(temp_str), "%.2f", temp);
     snprintf(hr_str, sizeof(hr_str), "%d", hr);
-    snprintf(lat_str, sizeof(lat_str), "%.5f", lat);
-    snprintf(lon_str, sizeof(lon_str), "%.5f", lon);
+    snprintf(spo2_str, sizeof(spo2_str), "%d", spo2);
+    snprintf(sqi_str, sizeof(sqi_str), "%d", sqi);
+    snprintf(qf_str, sizeof(qf_str), "%d", quality_flags);
+    snprintf(pi_str, sizeof(pi_str), "%.2f", perfusion);
+    snprintf(lc_str, sizeof(lc_str), "%.1f", led_current);
 
     // Add strings to JSON (not numbers)
     cJSON_AddStringToObject(doc, "i", dev_id);
     cJSON_AddStringToObject(doc, "t", temp_str);
+    if (ambient_valid)
+    {
+        snprintf(ta_str, sizeof(ta_str), "%.2f", ambient);
+        cJSON_AddStringToObject(doc, "ta", ta_str);
+    }
+    if (temp_comp_valid)
+    {
+        snprintf(tc_str, sizeof(tc_str), "%.2f", temp_comp);
+        cJSON_AddStringToObject(doc, "tc", tc_str);
+    }
     cJSON_AddStringToObject(doc, "h", hr_str);
-    cJSON_AddStringToObject(doc, "la", lat_str);
-    cJSON_AddStringToObject(doc, "lo", lon_str);
+    // Fields left at their defaults are not sent: SpO2 only when valid,
+    // the quality flags, perfusion and LED current only when something was
+    // wrong with the window, "nc" only when the sensor is off the skin
+    if (spo2_valid)
+    {
+        cJSON_AddStringToObject(doc, "s", spo2_str);
+    }
+    if (sqi > 0)
+    {
+        cJSON_AddStringToObject(doc, "q", sqi_str);
+    }
+    if (quality_flags != 0)
+    {
+        cJSON_AddStringToObject(doc, "qf", qf_str);
+        if (!no_contact)
+        {
+            cJSON_AddStringToObject(doc, "pi", pi_str);
+        }
+        cJSON_AddStringToObject(doc, "lc", lc_str);
+    }
+    if (no_contact)
+    {
+        cJSON_AddStringToObject(doc, "nc", "1");
+    }
+    // HRV is only sent when the window had enough clean beats
+    if (hrv_valid)
+    {
+        snprintf(rm_str, sizeof(rm_str), "%d", hrv.rmssd_ms);
+        snprintf(sd_str, sizeof(sd_str), "%d", hrv.sdnn_ms);
+        snprintf(pn_str, sizeof(pn_str), "%d", hrv.pnn50);
+        cJSON_AddStringToObject(doc, "rm", rm_str);
+        cJSON_AddStringToObject(doc, "sd", sd_str);
+        cJSON_AddStringToObject(doc, "pn", pn_str);
+    }
+    // Respiration only when a respiration window ran and gave a rate
+    if (resp_valid)
+    {
+        snprintf(rr_str, sizeof(rr_str), "%d", resp_rate);
+        snprintf(rc_str, sizeof(rc_str), "%d", resp_confidence);
+        cJSON_AddStringToObject(doc, "rr", rr_str);
+        cJSON_AddStringToObject(doc, "rc", rc_str);
+    }
+    // Position only when the GPS had one, "gq" says how far to trust it
+    if (gps_quality != FIX_QUALITY_NONE)
+    {
+        snprintf(gq_str, sizeof(gq_str), "%d", gps_quality);
+        cJSON_AddStringToObject(doc, "gq", gq_str);
+        add_position_json(doc, lat, lon);
+    }
+    // Age of a fix sent again for a resting animal
+    if (gps_age > 0)
+    {
+        snprintf(ga_str, sizeof(ga_str), "%lu", (unsigned long)gps_age);
+        cJSON_AddStringToObject(doc, "ga", ga_str);
+    }
+    // Zone status of an accepted fix against table "gi" (hex)
+    if (geofence_status != GEOFENCE_UNKNOWN)
+    {
+        snprintf(gf_str, sizeof(gf_str), "%d", geofence_status);
+        snprintf(gi_str, sizeof(gi_str), "%08lx", (unsigned long)geofence.id);
+        cJSON_AddStringToObject(doc, "gf", gf_str);
+        cJSON_AddStringToObject(doc, "gi", gi_str);
+    }
 
     // Compact Json
     *jsonStr = cJSON_PrintUnformatted(doc);
 
+    // Over the packet size the optional fields go, least useful first, rather
+    // than losing the whole uplink. Identity, vitals, contact, position and
+    // zone status always stay.
+    static const char *const drop_order[] = {"lc", "pi", "tc", "ta", "q", "rc", "pn", "sd", "rm", "rr", "ga", "s", "qf"};
+    for (int i = 0; i < (int)(sizeof(drop_order) / sizeof(drop_order[0])); i++)
+    {
+        if (*jsonStr == NULL || strlen(*jsonStr) <= LORA_MAX_PAYLOAD)
+        {
+            break;
+        }
+        if (!cJSON_HasObjectItem(doc, drop_order[i]))
+        {
+            continue;
+        }
+        // A withheld heart rate is only readable with its reason
+        if (hr == 0 && strcmp(drop_order[i], "qf") == 0)
+        {
+            continue;
+        }
+        ESP_LOGW("LORA_TX_MODE", "Uplink %d bytes, dropping \"%s\"", (int)strlen(*jsonStr), drop_order[i]);
+        cJSON_DeleteItemFromObject(doc, drop_order[i]);
+        free(*jsonStr);
+        *jsonStr = cJSON_PrintUnformatted(doc);
+    }
+
     // Clean up
     cJSON_Delete(doc);
 }
 
+// Meters north and east of the gateway, the full position when it is
+// unknown or the collar is beyond the offset range
+void add_position_json(cJSON *doc, int32_t lat, int32_t lon)
+{
+    char lat_str[13], lon_str[13], dn_str[8], de_str[8];
+    int16_t north, east;
+    if (zone_ref_valid && pos_encode_offset(zone_ref_lat, zone_ref_lon, lat, lon, &north, &east))
+    {
+        snprintf(dn_str, sizeof(dn_str), "%d", north);
+        snprintf(de_str, sizeof(de_str), "%d", east);
+        cJSON_AddStringToObject(doc, "dn", dn_str);
+        cJSON_AddStringToObject(doc, "de", de_str);
+    }
+    else
+    {
+        snprintf(lat_str, sizeof(lat_str), "%.7f", lat / 1e7);
+        snprintf(lon_str, sizeof(lon_str), "%.7f", lon / 1e7);
+        cJSON_AddStringToObject(doc, "la", lat_str);
+        cJSON_AddStringToObject(doc, "lo", lon_str);
+    }
+}
+
 void print_uint16_array(const uint16_t *arr, size_t len, const char *label)
 {
     printf("%s: ", label);
@@ -889,4 +1917,290 @@ void load_before_me(uint8_t *before_me, uint16_t *alloc_time, uint16_t *time_int
     {
         ESP_LOGE("NVS", "Failed to open NVS: %s", esp_err_to_name(err));
     }
-}
\ No newline at end of file
+}
+hr_engine_type_t load_hr_engine(void)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t engine = HR_ENGINE_ZERO_CROSSING;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_u8(cfg_nvs, "hr_engine", &engine);
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK || engine > HR_ENGINE_AUTOCORR)
+    {
+        engine = HR_ENGINE_ZERO_CROSSING;
+    }
+    ESP_LOGI("NVS", "Heart rate engine: %s", engine == HR_ENGINE_AUTOCORR ? "autocorrelation" : "zero crossing");
+    return (hr_engine_type_t)engine;
+}
+
+uint8_t load_resp_window(void)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t window_s = 0;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_u8(cfg_nvs, "resp_window", &window_s);
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK)
+    {
+        window_s = 0;
+    }
+    if (window_s > 0 && window_s < RESP_MIN_WINDOW_S)
+    {
+        window_s = RESP_MIN_WINDOW_S;
+    }
+    if (window_s > RESP_WINDOW_MAX_S)
+    {
+        window_s = RESP_WINDOW_MAX_S;
+    }
+    ESP_LOGI("NVS", "Respiration window: %d s", window_s);
+    return window_s;
+}
+
+uint8_t load_hrv_window(void)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t window_s = 0;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_u8(cfg_nvs, "hrv_window", &window_s);
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK)
+    {
+        window_s = 0;
+    }
+    if (window_s > 0 && window_s < HRV_MIN_WINDOW_S)
+    {
+        window_s = HRV_MIN_WINDOW_S;
+    }
+    if (window_s > HRV_WINDOW_MAX_S)
+    {
+        window_s = HRV_WINDOW_MAX_S;
+    }
+    ESP_LOGI("NVS", "HRV window: %d s", window_s);
+    return window_s;
+}
+
+// Longest time the slot leaves the MAX30102. The window opens on the
+// request to the collar before us, it has to close before ours comes one
+// slot later or the uplink would go out in someone else's slot.
+uint32_t hr_slot_limit_ms(void)
+{
+    uint32_t slot_ms = alloc_time * 1000UL;
+    return slot_ms > HR_SLOT_MARGIN_MS ? slot_ms - HR_SLOT_MARGIN_MS : UINT32_MAX;
+}
+
+// Longest time the MAX30102 may stay on in one wake
+uint32_t hr_window_cap_ms(void)
+{
+    uint32_t cap = resp_window_ms > HR_WINDOW_MAX_MS ? resp_window_ms : HR_WINDOW_MAX_MS;
+    if (hrv_window_ms > cap)
+    {
+        cap = hrv_window_ms;
+    }
+    uint32_t limit = hr_slot_limit_ms();
+    return cap < limit ? cap : limit;
+}
+
+// A measurement window the slot cannot hold is cut to fit, or turned off
+// (0) when what is left is shorter than min_ms and could never give a result
+uint32_t fit_window_to_slot(uint32_t window_ms, uint32_t min_ms, const char *name)
+{
+    uint32_t limit = hr_slot_limit_ms();
+    if (window_ms <= limit)
+    {
+        return window_ms;
+    }
+    if (limit < min_ms)
+    {
+        ESP_LOGW("SENSOR_MODE", "%s off, the %d s slot leaves %lu ms of the %lu ms needed", name, alloc_time, (unsigned long)limit, (unsigned long)min_ms);
+        return 0;
+    }
+    ESP_LOGW("SENSOR_MODE", "%s window cut to %lu ms by the %d s slot", name, (unsigned long)limit, alloc_time);
+    return limit;
+}
+
+float load_temp_comp(void)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t k = TEMP_COMP_K_DEFAULT;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_u8(cfg_nvs, "temp_k", &k);
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK)
+    {
+        k = TEMP_COMP_K_DEFAULT;
+    }
+    ESP_LOGI("NVS", "Temperature compensation k = %.2f", k / 100.0f);
+    return k / 100.0f;
+}
+
+uint8_t load_temp_resolution(void)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t bits = TEMP_RESOLUTION_DEFAULT;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_u8(cfg_nvs, "temp_res", &bits);
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK || bits < 9 || bits > 12)
+    {
+        bits = TEMP_RESOLUTION_DEFAULT;
+    }
+    ESP_LOGI("NVS", "Temperature resolution: %d bit", bits);
+    return bits;
+}
+
+uint8_t load_gps_mode(void)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t mode = GPS_MODE_NMEA;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_u8(cfg_nvs, "gps_mode", &mode);
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK || mode > GPS_MODE_UBX)
+    {
+        mode = GPS_MODE_NMEA;
+    }
+    ESP_LOGI("NVS", "GPS mode: %s", mode == GPS_MODE_UBX ? "UBX NAV-PVT" : "NMEA");
+    return mode;
+}
+
+// Fix acceptance criteria, returns how long the GPS may search (ms)
+uint32_t load_gps_criteria(fix_criteria_t *criteria)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t min_sats = GPS_MIN_SATS_DEFAULT;
+    uint8_t max_hdop = GPS_MAX_HDOP_DEFAULT;
+    uint8_t max_acc = GPS_MAX_ACC_DEFAULT;
+    uint8_t max_age = GPS_MAX_AGE_DEFAULT;
+    uint16_t timeout = GPS_TIMEOUT_DEFAULT;
+    if (nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs) == ESP_OK)
+    {
+        // Keys left unset keep their defaults
+        nvs_get_u8(cfg_nvs, "gps_min_sats", &min_sats);
+        nvs_get_u8(cfg_nvs, "gps_max_hdop", &max_hdop);
+        nvs_get_u8(cfg_nvs, "gps_max_acc", &max_acc);
+        nvs_get_u8(cfg_nvs, "gps_max_age", &max_age);
+        nvs_get_u16(cfg_nvs, "gps_timeout", &timeout);
+        nvs_close(cfg_nvs);
+    }
+    if (max_age == 0)
+    {
+        max_age = GPS_MAX_AGE_DEFAULT;
+    }
+    if (timeout == 0)
+    {
+        timeout = GPS_TIMEOUT_DEFAULT;
+    }
+
+    criteria->min_satellites = min_sats;
+    criteria->max_hdop = max_hdop * 10;
+    criteria->max_h_acc = max_acc * 1000UL;
+    criteria->max_age = max_age * 1000UL;
+    ESP_LOGI("NVS", "GPS fix: %d+ satellites, HDOP <= %.1f, accuracy <= %d m, age <= %d s, timeout %d s",
+             min_sats, max_hdop / 10.0f, max_acc, max_age, timeout);
+    return timeout * 1000UL;
+}
+
+uint8_t load_gps_max_skip(void)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t max_skip = GPS_MAX_SKIP_DEFAULT;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_u8(cfg_nvs, "gps_max_skip", &max_skip);
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK)
+    {
+        max_skip = GPS_MAX_SKIP_DEFAULT;
+    }
+    return max_skip;
+}
+
+// Gateway position from sensor_cfg (gw_lat/gw_lon, 1e-7 degrees), the prior for every collar in its zone
+bool load_gateway_position(int32_t *lat, int32_t *lon)
+{
+    nvs_handle_t cfg_nvs;
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_i32(cfg_nvs, "gw_lat", lat);
+        if (err == ESP_OK)
+        {
+            err = nvs_get_i32(cfg_nvs, "gw_lon", lon);
+        }
+        nvs_close(cfg_nvs);
+    }
+    return err == ESP_OK;
+}
+
+// Geofence table from sensor_cfg (blob "gf_table", the downlink payload), for a collar that lost RTC memory
+bool load_geofence(geofence_table_t *table)
+{
+    nvs_handle_t cfg_nvs;
+    uint8_t payload[GEOFENCE_TABLE_SIZE];
+    size_t len = sizeof(payload);
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READONLY, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_blob(cfg_nvs, "gf_table", payload, &len);
+        nvs_close(cfg_nvs);
+    }
+    return err == ESP_OK && geofence_parse(payload, len, table);
+}
+
+void save_geofence(const uint8_t *payload, size_t len)
+{
+    nvs_handle_t cfg_nvs;
+    if (len > GEOFENCE_TABLE_SIZE)
+    {
+        len = GEOFENCE_TABLE_SIZE;
+    }
+    esp_err_t err = nvs_open("sensor_cfg", NVS_READWRITE, &cfg_nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(cfg_nvs, "gf_table", payload, len);
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(cfg_nvs);
+        }
+        nvs_close(cfg_nvs);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("NVS", "Failed to save the geofence table");
+    }
+}
+
+// Read the die temperature started with the window, must run before the MAX30102 shuts down
+void collect_die_temperature(void)
+{
+    float die;
+    bool valid = max30102Sensor_read_die_temperature(&die);
+    xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10));
+    shared_data.ambient_temperature = valid ? die : 0;
+    shared_data.ambient_valid = valid;
+    xSemaphoreGive(data_mutex);
+    if (valid)
+    {
+        ESP_LOGI("HEART_RATE", "MAX30102 die temperature %.2f", die);
+    }
+}
@@ -0,0 +1,518 @@
+// Replays recorded GPS receiver output through the collar NMEA and UBX
+// parsers and fuzzes both, reporting throughput, checksum failures and the
+// decoded fixes against reference positions.
+//
+// Replay: gps_replay <log> [log ...]
+// A log is the raw receiver UART stream, NMEA text and UBX binary may be
+// mixed (e.g. `cat /dev/ttyUSB0 > walk.log`). When "<log>.ref" exists it
+// holds reference fixes, one "hhmmss,lat,lon" line each in degrees with
+// south and west negative, lines starting with '#' are comments. Every
+// decoded fix is compared with the reference of the same UTC second.
+//
+// Fuzz: gps_replay -f <iterations> [seed]
+// Generated sentences and NAV-PVT frames must decode to the values they
+// were built from, also with extra trailing terms. Mutated, truncated and
+// random input must keep the parser state within bounds. Build
+// gps_replay_asan to catch memory errors as well.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "tinygps.h"
+#include "ubx.h"
+
+#define TIMING_MIN_NS 200e6 // Repeat the timed pass until this long for stable numbers
+#define MAX_SENTENCE 200
+
+typedef struct
+{
+    uint32_t time; // hhmmss
+    double lat;
+    double lon;
+} ref_fix_t;
+
+typedef struct
+{
+    ref_fix_t *refs;
+    size_t count;
+} ref_list_t;
+
+//  Decoded fixes compared with the references
+typedef struct
+{
+    size_t fixes;
+    size_t matched;
+    double err_sum;
+    double max_err;
+} fix_stats_t;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    *len = fread(data, 1, size > 0 ? size : 0, f);
+    fclose(f);
+    return data;
+}
+
+static void load_refs(const char *log, ref_list_t *r)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s.ref", log);
+    r->refs = NULL;
+    r->count = 0;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return;
+
+    size_t cap = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        ref_fix_t ref;
+        unsigned t;
+        if (line[0] == '#' || sscanf(line, "%u,%lf,%lf", &t, &ref.lat, &ref.lon) != 3)
+            continue;
+        ref.time = t;
+        if (r->count == cap)
+        {
+            cap = cap ? cap * 2 : 256;
+            r->refs = realloc(r->refs, cap * sizeof(ref_fix_t));
+        }
+        r->refs[r->count++] = ref;
+    }
+    fclose(f);
+}
+
+static void score_fix(const ref_list_t *r, const gps_fix_t *fix, fix_stats_t *s)
+{
+    s->fixes++;
+    if (fix->time == GPS_INVALID_TIME)
+        return;
+
+    uint32_t t = fix->time / 100;
+    for (size_t i = 0; i < r->count; i++)
+    {
+        if (r->refs[i].time != t)
+            continue;
+        double err = gps_distance_between(fix->latitude / 1e7, fix->longitude / 1e7,
+                                          r->refs[i].lat, r->refs[i].lon);
+        s->matched++;
+        s->err_sum += err;
+        if (err > s->max_err)
+            s->max_err = err;
+        return;
+    }
+}
+
+static void print_fix_stats(const char *name, const fix_stats_t *s, const ref_list_t *r)
+{
+    printf("  %-5s fixes %6zu", name, s->fixes);
+    if (r->count > 0)
+    {
+        printf("  matched %6zu", s->matched);
+        if (s->matched > 0)
+            printf("  mean err %6.2f m  max err %6.2f m", s->err_sum / s->matched, s->max_err);
+    }
+    printf("\n");
+}
+
+static void replay(const char *path)
+{
+    size_t len;
+    uint8_t *data = load_file(path, &len);
+    if (data == NULL)
+        return;
+
+    ref_list_t refs;
+    load_refs(path, &refs);
+    printf("%s: %zu bytes, %zu reference fixes\n", path, len, refs.count);
+
+    // Decode once for the fixes
+    static gps_ctx_t gps;
+    static ubx_ctx_t ubx;
+    fix_stats_t nmea_fixes = {0}, ubx_fixes = {0};
+    size_t nav_pvt = 0;
+    gps_ctx_init(&gps);
+    ubx_init(&ubx);
+    for (size_t i = 0; i < len; i++)
+    {
+        gps_fix_t fix;
+        if (gps_ctx_encode(&gps, data[i]) && gps_ctx_get_fix(&gps, &fix))
+            score_fix(&refs, &fix, &nmea_fixes);
+
+        ubx_nav_pvt_t pvt;
+        if (ubx_decode(&ubx, data[i]) && ubx_nav_pvt(&ubx, &pvt))
+        {
+            nav_pvt++;
+            if (ubx_pvt_has_fix(&pvt))
+            {
+                ubx_pvt_to_fix(&pvt, &fix);
+                score_fix(&refs, &fix, &ubx_fixes);
+            }
+        }
+    }
+
+    unsigned long chars;
+    unsigned short good, failed;
+    gps_ctx_stats(&gps, &chars, &good, &failed);
+    printf("  nmea  %hu good sentences, %hu failed checksums\n", good, failed);
+    printf("  ubx   %lu good frames (%zu NAV-PVT), %hu failed checksums\n",
+           ubx.good_frames, nav_pvt, ubx.failed_checksum);
+    print_fix_stats("nmea", &nmea_fixes, &refs);
+    print_fix_stats("ubx", &ubx_fixes, &refs);
+
+    // Then time each parser alone
+    int reps = 0;
+    double ns = 0;
+    while (ns < TIMING_MIN_NS && len > 0)
+    {
+        gps_ctx_init(&gps);
+        double start = now_ns();
+        for (size_t i = 0; i < len; i++)
+            gps_ctx_encode(&gps, data[i]);
+        ns += now_ns() - start;
+        reps++;
+    }
+    if (reps > 0)
+        printf("  nmea  %7.1f ns/byte  %9.0f sentences/s\n", ns / ((double)len * reps), good * reps / (ns / 1e9));
+
+    reps = 0;
+    ns = 0;
+    while (ns < TIMING_MIN_NS && len > 0)
+    {
+        ubx_init(&ubx);
+        double start = now_ns();
+        for (size_t i = 0; i < len; i++)
+            ubx_decode(&ubx, data[i]);
+        ns += now_ns() - start;
+        reps++;
+    }
+    if (reps > 0)
+        printf("  ubx   %7.1f ns/byte  %9.0f frames/s\n", ns / ((double)len * reps), ubx.good_frames * reps / (ns / 1e9));
+
+    free(refs.refs);
+    free(data);
+}
+
+// xorshift32, reproducible across hosts
+static uint32_t rng_state;
+
+static uint32_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t rnd_range(uint32_t n)
+{
+    return rnd() % n;
+}
+
+typedef struct
+{
+    bool gga;
+    uint32_t time;     // hhmmss
+    int32_t lat, lon;  // expected 1e-7 degrees
+    uint8_t satellites;
+    uint32_t hdop;     // 100ths
+    int extra_terms;   // appended after the last field
+    char text[MAX_SENTENCE];
+    size_t len;
+} gen_sentence_t;
+
+// dddmm.mmmmm of a random position, returns the 1e-7 degrees tinygps makes of it
+static int32_t gen_degrees(char *out, size_t size, int deg_digits, uint32_t max_deg)
+{
+    uint32_t deg = rnd_range(max_deg);
+    uint32_t min_e5 = rnd_range(60 * 100000);
+    snprintf(out, size, "%0*u%02u.%05u", deg_digits, deg, min_e5 / 100000, min_e5 % 100000);
+    return deg * 10000000L + ((long)min_e5 * 10 + 3) / 6;
+}
+
+static void finish_sentence(gen_sentence_t *g, char *body)
+{
+    // Fields a newer receiver may add, the parser must skip them
+    for (int i = 0; i < g->extra_terms; i++)
+        strcat(body, i % 2 ? ",0" : ",A");
+    uint8_t parity = 0;
+    for (const char *p = body; *p; p++)
+        parity ^= *p;
+    g->len = snprintf(g->text, sizeof(g->text), "$%s*%02X\r\n", body, parity);
+}
+
+static void gen_sentence(gen_sentence_t *g)
+{
+    char lat[16], lon[16], body[MAX_SENTENCE];
+    bool south = rnd() & 1, west = rnd() & 1;
+    g->gga = rnd() & 1;
+    g->time = rnd_range(24) * 10000 + rnd_range(60) * 100 + rnd_range(60);
+    g->lat = gen_degrees(lat, sizeof(lat), 2, 90) * (south ? -1 : 1);
+    g->lon = gen_degrees(lon, sizeof(lon), 3, 180) * (west ? -1 : 1);
+    g->satellites = 1 + rnd_range(24);
+    g->hdop = 50 + rnd_range(5000);
+    g->extra_terms = rnd_range(4) == 0 ? (int)rnd_range(36) : 0;
+
+    if (g->gga)
+        snprintf(body, sizeof(body) - 80, "GPGGA,%06u.00,%s,%c,%s,%c,1,%02u,%u.%02u,%d.%d,M,46.9,M,,",
+                 g->time, lat, south ? 'S' : 'N', lon, west ? 'W' : 'E',
+                 g->satellites, g->hdop / 100, g->hdop % 100, (int)rnd_range(3000), (int)rnd_range(10));
+    else
+        snprintf(body, sizeof(body) - 80, "GPRMC,%06u.00,A,%s,%c,%s,%c,%u.%02u,%u.%02u,%06u,,,A",
+                 g->time, lat, south ? 'S' : 'N', lon, west ? 'W' : 'E',
+                 rnd_range(50), rnd_range(100), rnd_range(360), rnd_range(100), 10125);
+    finish_sentence(g, body);
+}
+
+// Random damage: flipped, dropped and inserted bytes, NMEA delimiters and overlong terms
+static size_t mutate(char *s, size_t len, size_t size)
+{
+    static const char specials[] = ",*$\r\n";
+    int edits = 1 + rnd_range(4);
+    for (int e = 0; e < edits && len > 0; e++)
+    {
+        size_t at = rnd_range(len);
+        switch (rnd_range(5))
+        {
+        case 0:
+            s[at] ^= 1 << rnd_range(8);
+            break;
+        case 1:
+            memmove(s + at, s + at + 1, len - at - 1);
+            len--;
+            break;
+        case 2:
+            if (len < size)
+            {
+                memmove(s + at + 1, s + at, len - at);
+                s[at] = specials[rnd_range(sizeof(specials) - 1)];
+                len++;
+            }
+            break;
+        case 3:
+            s[at] = rnd();
+            break;
+        case 4:
+            // A term far longer than gps_ctx_t.term
+            for (size_t n = 16 + rnd_range(300); n > 0 && len < size; n--)
+            {
+                memmove(s + at + 1, s + at, len - at);
+                s[at] = 'A' + rnd_range(26);
+                len++;
+            }
+            break;
+        }
+    }
+    return len;
+}
+
+typedef struct
+{
+    size_t sentences, decoded, mismatched;
+    size_t mutated, mutated_accepted;
+    size_t frames, frames_decoded, frames_mismatched, frames_resynced;
+    size_t random_bytes;
+    size_t state_errors;
+} fuzz_stats_t;
+
+static void feed_checked(gps_ctx_t *gps, const uint8_t *data, size_t len, fuzz_stats_t *s, bool *valid)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (gps_ctx_encode(gps, data[i]) && valid != NULL)
+            *valid = true;
+        if (gps->term_offset >= sizeof(gps->term))
+            s->state_errors++;
+    }
+}
+
+static void fuzz_nmea(gps_ctx_t *gps, fuzz_stats_t *s)
+{
+    gen_sentence_t g;
+    gen_sentence(&g);
+
+    // Clean sentence, possibly with extra empty terms, decodes to what was generated
+    bool valid = false;
+    gps_fix_t fix;
+    gps_ctx_init(gps);
+    feed_checked(gps, (const uint8_t *)g.text, g.len, s, &valid);
+    s->sentences++;
+    if (valid && gps_ctx_get_fix(gps, &fix))
+    {
+        s->decoded++;
+        bool same = fix.latitude == g.lat && fix.longitude == g.lon && fix.time / 100 == g.time;
+        if (g.gga)
+            same = same && fix.satellites == g.satellites && fix.hdop == g.hdop;
+        if (!same)
+        {
+            s->mismatched++;
+            if (s->mismatched <= 5)
+                printf("  mismatch: %.*s    got %ld %ld %lu\n", (int)g.len - 2, g.text,
+                       (long)fix.latitude, (long)fix.longitude, (unsigned long)fix.time);
+        }
+    }
+    else
+    {
+        s->mismatched++;
+        if (s->mismatched <= 5)
+            printf("  rejected: %.*s\n", (int)g.len - 2, g.text);
+    }
+
+    // Damaged copy fed into the same parser, the state must stay in bounds
+    char damaged[1024];
+    memcpy(damaged, g.text, g.len);
+    size_t len = mutate(damaged, g.len, sizeof(damaged));
+    valid = false;
+    feed_checked(gps, (const uint8_t *)damaged, len, s, &valid);
+    s->mutated++;
+    if (valid)
+        s->mutated_accepted++;
+}
+
+static size_t gen_nav_pvt(uint8_t *frame, ubx_nav_pvt_t *want)
+{
+    uint8_t p[UBX_NAV_PVT_LEN] = {0};
+    want->fix_type = rnd_range(6);
+    want->flags = rnd() & 1;
+    want->num_sv = rnd_range(40);
+    want->lat = (int32_t)rnd_range(1800000000) - 900000000;
+    want->lon = (int32_t)(rnd() % 3600000000u - 1800000000u);
+    want->h_acc = rnd_range(100000);
+    p[20] = want->fix_type;
+    p[21] = want->flags;
+    p[23] = want->num_sv;
+    memcpy(p + 24, &want->lon, 4); // little endian host
+    memcpy(p + 28, &want->lat, 4);
+    memcpy(p + 40, &want->h_acc, 4);
+    return ubx_frame(UBX_CLASS_NAV, UBX_NAV_PVT, p, sizeof(p), frame);
+}
+
+static void fuzz_ubx(ubx_ctx_t *ubx, fuzz_stats_t *s)
+{
+    uint8_t frame[UBX_NAV_PVT_LEN + UBX_FRAME_OVERHEAD];
+    ubx_nav_pvt_t want, got;
+    size_t len = gen_nav_pvt(frame, &want);
+
+    // Garbage first half the time: a damaged frame, random bytes or a
+    // header with a length past the payload buffer
+    int lead = rnd_range(6);
+    if (lead == 1 || lead == 2)
+    {
+        uint8_t damaged[sizeof(frame)];
+        memcpy(damaged, frame, len);
+        damaged[2 + rnd_range(len - 2)] ^= 1 << rnd_range(8);
+        for (size_t i = 0; i < len; i++)
+            ubx_decode(ubx, damaged[i]);
+    }
+    else if (lead == 3)
+    {
+        for (int n = rnd_range(64); n > 0; n--)
+            ubx_decode(ubx, rnd());
+    }
+    else if (lead == 4)
+    {
+        uint16_t big = UBX_MAX_PAYLOAD + 1 + rnd_range(400);
+        uint8_t head[] = {UBX_SYNC_1, UBX_SYNC_2, UBX_CLASS_NAV, UBX_NAV_PVT, big & 0xFF, big >> 8};
+        for (size_t i = 0; i < sizeof(head); i++)
+            ubx_decode(ubx, head[i]);
+        for (int n = big + 2; n > 0; n--)
+            ubx_decode(ubx, rnd());
+    }
+    if (ubx->offset > ubx->length || (ubx->overflow && ubx->length <= UBX_MAX_PAYLOAD))
+        s->state_errors++;
+
+    // A damaged frame can swallow the start of the next one, resend it then
+    bool decoded = false;
+    for (int attempt = 0; attempt < 2 && !decoded; attempt++)
+    {
+        for (size_t i = 0; i < len; i++)
+            if (ubx_decode(ubx, frame[i]) && ubx_nav_pvt(ubx, &got))
+                decoded = true;
+        if (decoded && attempt > 0)
+            s->frames_resynced++;
+    }
+    s->frames++;
+    if (!decoded)
+        return;
+
+    s->frames_decoded++;
+    if (got.lat != want.lat || got.lon != want.lon || got.num_sv != want.num_sv ||
+        got.h_acc != want.h_acc || got.fix_type != want.fix_type ||
+        ubx_pvt_has_fix(&got) != ((want.flags & 1) && want.fix_type >= UBX_FIX_2D && want.fix_type <= UBX_FIX_GNSS_DR))
+        s->frames_mismatched++;
+}
+
+static int fuzz(long iterations, uint32_t seed)
+{
+    static gps_ctx_t gps;
+    static ubx_ctx_t ubx;
+    fuzz_stats_t s = {0};
+    rng_state = seed ? seed : 1;
+    ubx_init(&ubx);
+
+    double start = now_ns();
+    for (long i = 0; i < iterations; i++)
+    {
+        fuzz_nmea(&gps, &s);
+        fuzz_ubx(&ubx, &s);
+
+        // Plain noise into both
+        uint8_t noise[64];
+        for (size_t n = 0; n < sizeof(noise); n++)
+            noise[n] = rnd();
+        feed_checked(&gps, noise, sizeof(noise), &s, NULL);
+        for (size_t n = 0; n < sizeof(noise); n++)
+            ubx_decode(&ubx, noise[n]);
+        s.random_bytes += sizeof(noise);
+    }
+    double secs = (now_ns() - start) / 1e9;
+
+    printf("fuzz: %ld iterations, seed %u, %.1f s\n", iterations, seed, secs);
+    printf("  nmea  %zu sentences, %zu decoded, %zu mismatched\n", s.sentences, s.decoded, s.mismatched);
+    printf("  nmea  %zu damaged copies, %zu still passed the checksum\n", s.mutated, s.mutated_accepted);
+    printf("  ubx   %zu NAV-PVT frames, %zu decoded (%zu after a resend), %zu mismatched\n",
+           s.frames, s.frames_decoded, s.frames_resynced, s.frames_mismatched);
+    printf("  %zu random bytes, %zu parser state errors\n", s.random_bytes, s.state_errors);
+
+    // Every clean sentence must decode, a frame may be lost to a preceding
+    // damaged length but never misread
+    bool ok = s.mismatched == 0 && s.frames_mismatched == 0 && s.state_errors == 0;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "-f") == 0)
+        return fuzz(atol(argv[2]), argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 0) : (uint32_t)time(NULL));
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <log> [log ...]\n", argv[0]);
+        fprintf(stderr, "       %s -f <iterations> [seed]\n", argv[0]);
+        return 1;
+    }
+
+    for (int f = 1; f < argc; f++)
+        replay(argv[f]);
+    return 0;
+}
@@ -0,0 +1,169 @@
+// Records the raw MAX30102 stream of a collar built with -D PPG_CAPTURE into
+// a trace file for tools/ppg_replay.
+//
+// The collar prints "PPG_START", one "PPG,<red>,<ir>" line per sample and
+// "PPG_END" when the heart rate window closes. Other console output is
+// ignored. Typing a heart rate (counted by hand or read off a reference
+// monitor) followed by Enter while recording inserts a "# bpm=" annotation
+// at the current sample, "s" and a saturation (s97) a "# spo2=" one.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#define CONSOLE_BAUD B115200 // monitor_speed in platformio.ini
+
+static int open_serial(const char *dev)
+{
+    int fd = open(dev, O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(dev);
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+    {
+        perror("tcgetattr");
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, CONSOLE_BAUD);
+    cfsetospeed(&tio, CONSOLE_BAUD);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+        perror("tcsetattr");
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argc > 4)
+    {
+        fprintf(stderr, "usage: %s <serial device> <trace.csv> [reference bpm]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open_serial(argv[1]);
+    if (fd < 0)
+        return 1;
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL)
+    {
+        perror(argv[2]);
+        close(fd);
+        return 1;
+    }
+    fprintf(out, "# MAX30102 trace, 100 Hz, red,ir\n");
+    if (argc == 4)
+        fprintf(out, "# bpm=%s\n", argv[3]);
+
+    char line[128];
+    size_t len = 0;
+    size_t samples = 0;
+    int recording = 0;
+    int stdin_open = 1;
+
+    fprintf(stderr, "waiting for PPG_START on %s\n", argv[1]);
+    while (1)
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        if (stdin_open)
+            FD_SET(STDIN_FILENO, &fds);
+        if (select(fd + 1, &fds, NULL, NULL, NULL) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("select");
+            break;
+        }
+
+        // Reference heart rate typed by the operator
+        if (stdin_open && FD_ISSET(STDIN_FILENO, &fds))
+        {
+            char input[32];
+            if (fgets(input, sizeof(input), stdin) == NULL)
+            {
+                stdin_open = 0;
+            }
+            else
+            {
+                int spo2 = (input[0] == 's' || input[0] == 'S') ? atoi(input + 1) : 0;
+                int bpm = spo2 > 0 ? 0 : atoi(input);
+                if (spo2 > 0)
+                {
+                    fprintf(out, "# spo2=%d\n", spo2);
+                    fprintf(stderr, "spo2=%d at sample %zu\n", spo2, samples);
+                }
+                else if (bpm > 0)
+                {
+                    fprintf(out, "# bpm=%d\n", bpm);
+                    fprintf(stderr, "bpm=%d at sample %zu\n", bpm, samples);
+                }
+            }
+        }
+
+        if (!FD_ISSET(fd, &fds))
+            continue;
+
+        char c;
+        ssize_t n = read(fd, &c, 1);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            fprintf(stderr, "serial closed\n");
+            break;
+        }
+        if (c == '\r')
+            continue;
+        if (c != '\n')
+        {
+            if (len < sizeof(line) - 1)
+                line[len++] = c;
+            continue;
+        }
+        line[len] = '\0';
+        len = 0;
+
+        if (strcmp(line, "PPG_START") == 0)
+        {
+            recording = 1;
+            fprintf(stderr, "recording\n");
+        }
+        else if (strcmp(line, "PPG_END") == 0 && recording)
+        {
+            break;
+        }
+        else if (recording && strncmp(line, "PPG,", 4) == 0)
+        {
+            unsigned red, ir;
+            if (sscanf(line + 4, "%u,%u", &red, &ir) == 2)
+            {
+                fprintf(out, "%u,%u\n", red, ir);
+                samples++;
+            }
+        }
+    }
+
+    fprintf(stderr, "%zu samples (%.1f s) written to %s\n", samples, samples / 100.0, argv[2]);
+    fclose(out);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,278 @@
+// Replays recorded MAX30102 traces through both heart rate engines and the
+// SpO2 estimator and reports their accuracy against the reference values
+// and their CPU cost.
+//
+// Input: one "red,ir" sample per line at 100 Hz (the collar FIFO rate), as
+// written by tools/ppg_capture. Lines starting with '#' are comments,
+// "# bpm=<bpm>" and "# spo2=<percent>" set the reference heart rate and
+// saturation from that sample onwards (0 = unknown, not scored).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "hrEngine.h"
+#include "spo2.h"
+
+#define SAMPLE_PERIOD_US 10000 // MAX30102_SAMPLE_PERIOD_US
+#define BATCH_SAMPLES 17       // FIFO almost full batch used on the collar
+#define WARMUP_US 3000000      // Estimates before this are not scored
+
+typedef struct
+{
+    uint16_t *red;
+    uint16_t *ir;
+    float *ref_bpm;  // reference heart rate of each sample
+    float *ref_spo2; // reference saturation of each sample
+    size_t count;
+} trace_t;
+
+//  Error statistics of one engine, over one file or all of them
+typedef struct
+{
+    size_t scored;   // batches with a reference rate
+    size_t reported; // of those, batches where the engine gave a rate
+    double err_sum;
+    double abs_sum;
+    double sq_sum;
+    double max_abs;
+    double ns;
+    size_t samples;
+} replay_stats_t;
+
+static int load_trace(const char *path, trace_t *t)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    size_t cap = 4096;
+    t->red = malloc(cap * sizeof(uint16_t));
+    t->ir = malloc(cap * sizeof(uint16_t));
+    t->ref_bpm = malloc(cap * sizeof(float));
+    t->ref_spo2 = malloc(cap * sizeof(float));
+    t->count = 0;
+    float ref = 0;
+    float ref_spo2 = 0;
+
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (line[0] == '#')
+        {
+            char *bpm = strstr(line, "bpm=");
+            if (bpm != NULL)
+                ref = strtof(bpm + 4, NULL);
+            char *spo2 = strstr(line, "spo2=");
+            if (spo2 != NULL)
+                ref_spo2 = strtof(spo2 + 5, NULL);
+            continue;
+        }
+
+        unsigned red, ir;
+        if (sscanf(line, "%u,%u", &red, &ir) != 2)
+            continue;
+
+        if (t->count == cap)
+        {
+            cap *= 2;
+            t->red = realloc(t->red, cap * sizeof(uint16_t));
+            t->ir = realloc(t->ir, cap * sizeof(uint16_t));
+            t->ref_bpm = realloc(t->ref_bpm, cap * sizeof(float));
+            t->ref_spo2 = realloc(t->ref_spo2, cap * sizeof(float));
+        }
+        t->red[t->count] = (uint16_t)red;
+        t->ir[t->count] = (uint16_t)ir;
+        t->ref_bpm[t->count] = ref;
+        t->ref_spo2[t->count] = ref_spo2;
+        t->count++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void replay(const trace_t *t, hr_engine_type_t type, replay_stats_t *s)
+{
+    static hr_engine_t engine;
+    hrEngineInit(&engine, type);
+    memset(s, 0, sizeof(*s));
+
+    // Run the engine alone first so the timing is not skewed by the scoring
+    double start = now_ns();
+    for (size_t i = 0; i < t->count; i++)
+    {
+        hrEngineAddSample(&engine, t->ir[i], (int64_t)i * SAMPLE_PERIOD_US);
+        if ((i + 1) % BATCH_SAMPLES == 0)
+            hrEngineUpdate(&engine);
+    }
+    s->ns = now_ns() - start;
+    s->samples = t->count;
+
+    hrEngineInit(&engine, type);
+    for (size_t i = 0; i < t->count; i++)
+    {
+        int64_t t_us = (int64_t)i * SAMPLE_PERIOD_US;
+        hrEngineAddSample(&engine, t->ir[i], t_us);
+
+        if ((i + 1) % BATCH_SAMPLES != 0)
+            continue;
+
+        hrEngineUpdate(&engine);
+        uint8_t confidence;
+        int bpm = hrEngineBpm(&engine, &confidence);
+
+        if (t_us < WARMUP_US || t->ref_bpm[i] <= 0)
+            continue;
+        s->scored++;
+        if (bpm <= 0)
+            continue;
+
+        double err = bpm - t->ref_bpm[i];
+        s->reported++;
+        s->err_sum += err;
+        s->abs_sum += fabs(err);
+        s->sq_sum += err * err;
+        if (fabs(err) > s->max_abs)
+            s->max_abs = fabs(err);
+    }
+}
+
+//  Error statistics of the SpO2 estimate, fed the same batches as on the
+//  collar. A batch counts as reported when the estimate passed its checks.
+static void replay_spo2(const trace_t *t, replay_stats_t *s)
+{
+    spo2_t spo2;
+    memset(s, 0, sizeof(*s));
+
+    spo2Reset(&spo2);
+    double start = now_ns();
+    for (size_t i = 0; i + BATCH_SAMPLES <= t->count; i += BATCH_SAMPLES)
+        spo2AddSamples(&spo2, &t->red[i], &t->ir[i], BATCH_SAMPLES);
+    s->ns = now_ns() - start;
+    s->samples = t->count;
+
+    spo2Reset(&spo2);
+    for (size_t i = 0; i + BATCH_SAMPLES <= t->count; i += BATCH_SAMPLES)
+    {
+        spo2AddSamples(&spo2, &t->red[i], &t->ir[i], BATCH_SAMPLES);
+        uint8_t value;
+        bool valid = spo2Estimate(&spo2, &value);
+
+        size_t last = i + BATCH_SAMPLES - 1;
+        if ((int64_t)last * SAMPLE_PERIOD_US < WARMUP_US || t->ref_spo2[last] <= 0)
+            continue;
+        s->scored++;
+        if (!valid)
+            continue;
+
+        double err = value - t->ref_spo2[last];
+        s->reported++;
+        s->err_sum += err;
+        s->abs_sum += fabs(err);
+        s->sq_sum += err * err;
+        if (fabs(err) > s->max_abs)
+            s->max_abs = fabs(err);
+    }
+}
+
+static void accumulate(replay_stats_t *total, const replay_stats_t *s)
+{
+    total->scored += s->scored;
+    total->reported += s->reported;
+    total->err_sum += s->err_sum;
+    total->abs_sum += s->abs_sum;
+    total->sq_sum += s->sq_sum;
+    if (s->max_abs > total->max_abs)
+        total->max_abs = s->max_abs;
+    total->ns += s->ns;
+    total->samples += s->samples;
+}
+
+static void print_stats(const char *name, const replay_stats_t *s)
+{
+    printf("  %-14s", name);
+    if (s->reported > 0)
+    {
+        double n = s->reported;
+        printf("mae %5.1f  rmse %5.1f  bias %+5.1f  max %5.1f  ",
+               s->abs_sum / n, sqrt(s->sq_sum / n), s->err_sum / n, s->max_abs);
+    }
+    else
+    {
+        printf("mae   n/a  rmse   n/a  bias   n/a  max   n/a  ");
+    }
+    printf("coverage %3.0f%%  %7.1f ns/sample\n",
+           s->scored ? 100.0 * s->reported / s->scored : 0.0,
+           s->samples ? s->ns / s->samples : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <trace.csv> [trace.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    static const struct
+    {
+        hr_engine_type_t type;
+        const char *name;
+    } engines[] = {
+        {HR_ENGINE_ZERO_CROSSING, "zero-crossing"},
+        {HR_ENGINE_AUTOCORR, "autocorr"},
+    };
+    const size_t n_engines = sizeof(engines) / sizeof(engines[0]);
+    replay_stats_t totals[sizeof(engines) / sizeof(engines[0])];
+    replay_stats_t spo2_total;
+    memset(totals, 0, sizeof(totals));
+    memset(&spo2_total, 0, sizeof(spo2_total));
+
+    int files = 0;
+    for (int f = 1; f < argc; f++)
+    {
+        trace_t trace;
+        if (load_trace(argv[f], &trace) != 0)
+            continue;
+        files++;
+
+        printf("%s: %zu samples (%.1f s)\n", argv[f], trace.count,
+               trace.count * SAMPLE_PERIOD_US / 1e6);
+        for (size_t e = 0; e < n_engines; e++)
+        {
+            replay_stats_t s;
+            replay(&trace, engines[e].type, &s);
+            print_stats(engines[e].name, &s);
+            accumulate(&totals[e], &s);
+        }
+        replay_stats_t s;
+        replay_spo2(&trace, &s);
+        print_stats("spo2", &s);
+        accumulate(&spo2_total, &s);
+
+        free(trace.red);
+        free(trace.ir);
+        free(trace.ref_bpm);
+        free(trace.ref_spo2);
+    }
+
+    if (files > 1)
+    {
+        printf("all %d files:\n", files);
+        for (size_t e = 0; e < n_engines; e++)
+            print_stats(engines[e].name, &totals[e]);
+        print_stats("spo2", &spo2_total);
+    }
+    return files > 0 ? 0 : 1;
+}
@@ -0,0 +1,24 @@
+import { mqttClient } from '../services/mqttClient';
+import { EVERY_COLLAR, buildSettingsFrame } from '../services/collarSettings';
+
+// Sends settings to one collar (":deviceId") or to all of them ("all"),
+// body { settings: { hr_engine: 1, resp_window: 30, ... } }
+module.exports.update = async (req: any, res: any) => {
+  const deviceId =
+    req.params.deviceId === 'all' ? EVERY_COLLAR : parseInt(req.params.deviceId);
+  const { settings } = req.body;
+
+  if (isNaN(deviceId) || deviceId < 0 || deviceId > EVERY_COLLAR || !settings) {
+    return res.status(400).json({ message: 'Device id and settings are required' });
+  }
+  try {
+    const frame = buildSettingsFrame(deviceId, settings);
+    mqttClient.publishCollarSettings(deviceId, frame);
+    res.status(200).json({ message: 'Settings sent to the gateway' });
+  } catch (error: any) {
+    res.status(400).json({
+      message: 'Error in sending collar settings',
+      error: error.message,
+    });
+  }
+};
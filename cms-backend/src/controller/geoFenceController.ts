@@ -1,4 +1,5 @@
 import geoFenceModel from '../model/geoFenceModel';
+import { mqttClient } from '../services/mqttClient';
 
 module.exports.getAll = async (req: any, res: any) => {
   try {
@@ -23,6 +24,7 @@ module.exports.new = async (req: any, res: any) => {
       zoneName,
     });
     await geoFence.save();
+    mqttClient.publishGeofenceTable();
     res.status(201).json({ message: 'Geofence created successfully' });
   } catch (error: any) {
     res
@@ -40,6 +42,7 @@ module.exports.deleteGoefence = async (req: any, res: any) => {
     if (!geoFence) {
       return res.status(404).json({ message: 'Geofence not found' });
     }
+    mqttClient.publishGeofenceTable();
     res.status(200).json({ message: 'Geofence deleted successfully' });
   } catch (error: any) {
     res
@@ -1,4 +1,5 @@
 import { ThresholdModel } from '../model/sensorThresholdModel';
+import { mqttClient } from '../services/mqttClient';
 
 module.exports.get = async (req: any, res: any) => {
   try {
@@ -34,6 +35,8 @@ module.exports.update = async (req: any, res: any) => {
         upsert: true,
       }
     );
+    // The geofence warning buffer goes to the collars with the zones
+    mqttClient.publishGeofenceTable();
     res.status(200).json(updatedThresholds);
   } catch (error: any) {
     res.status(500).json({
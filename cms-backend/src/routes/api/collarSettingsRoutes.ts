@@ -0,0 +1,8 @@
+import { Router } from 'express';
+const collarSettingsController = require('../../controller/collarSettingsController');
+
+const router = Router();
+
+router.put('/:deviceId', collarSettingsController.update);
+
+export { router as collarSettingsRouter };
@@ -11,6 +11,7 @@ import { geoFenceRouter } from './routes/api/geoFenceRoutes';
 import { mapRouter } from './routes/api/mapRoutes';
 import { sensorThresholdRouter } from './routes/api/sensorThresholdRoutes';
 import { receiverConfigRouter } from './routes/api/receiverConfigRoutes';
+import { collarSettingsRouter } from './routes/api/collarSettingsRoutes';
 import { createServer } from 'http';
 import { Server } from 'socket.io';
 import { setSocketIOInstance } from './socket';
@@ -61,6 +62,7 @@ app.use('/api/cattle', cattleRouter);
 app.use('/api/sensor', sensorDataRouter);
 app.use('/api/threshold', sensorThresholdRouter);
 app.use('/api/configurations', receiverConfigRouter);
+app.use('/api/collar-settings', collarSettingsRouter);
 // app.use('/notification', notificationRouter);
 
 
@@ -71,6 +73,7 @@ mongoose
   .connect(DB_CONNECTION)
   .then(() => {
     console.log('Database Connection successful');
+    mqttClient.publishGeofenceTable();
     httpServer.listen(PORT, () => {
       console.log(`Server running on port ${PORT}`);
     });
@@ -0,0 +1,43 @@
+// Must match the collar's sensor_cfg_keys, the index is the setting id
+export const COLLAR_SETTINGS = [
+  'hr_engine', // 0 zero crossing, 1 autocorrelation
+  'resp_window', // s, 0 = no respiration rate
+  'temp_k', // ambient compensation, hundredths, 0 = off
+  'temp_res', // DS18B20 resolution, 9..12 bits
+  'gps_mode', // 0 NMEA, 1 UBX NAV-PVT
+  'gps_min_sats',
+  'gps_max_hdop', // tenths
+  'gps_max_acc', // m
+  'gps_max_age', // s
+  'gps_max_skip',
+  'hrv_window', // s, 0 = no HRV
+];
+
+const SETTINGS_FRAME = 0xd0;
+export const EVERY_COLLAR = 0xffff;
+
+// Downlink frame the gateway sends to the collars:
+// 0xD0, device id (u16, 0xFFFF = every collar), then per setting its id
+// and value (u8). The collars keep the values in NVS and use them from
+// the next wake on. Throws on an unknown setting or a value out of range.
+export const buildSettingsFrame = (
+  deviceId: number,
+  settings: Record<string, number>
+): Buffer => {
+  const entries = Object.entries(settings);
+  const frame = Buffer.alloc(3 + entries.length * 2);
+  frame.writeUInt8(SETTINGS_FRAME, 0);
+  frame.writeUInt16LE(deviceId, 1);
+  entries.forEach(([name, value], i) => {
+    const id = COLLAR_SETTINGS.indexOf(name);
+    if (id < 0) {
+      throw new Error(`Unknown collar setting ${name}`);
+    }
+    if (!Number.isInteger(value) || value < 0 || value > 0xff) {
+      throw new Error(`Collar setting ${name} must be 0..255, got ${value}`);
+    }
+    frame.writeUInt8(id, 3 + i * 2);
+    frame.writeUInt8(value, 4 + i * 2);
+  });
+  return frame;
+};
@@ -6,6 +6,7 @@ import Notification from '../model/notificationModel';
 import { getSocketIOInstance } from '../socket';
 import { ThresholdModel } from '../model/sensorThresholdModel';
 import cattle from '../model/cattle';
+import { getGeofenceTableId } from './geofenceTable';
 
 export enum ZoneStatus {
   Safe = 'SAFE',
@@ -17,6 +18,7 @@ export enum ZoneStatus {
 export enum HeartRateStatus {
   Safe = 'SAFE',
   Danger = 'DANGER',
+  Unknown = 'UNKNOWN', // the collar withheld a reading it could not trust
 }
 
 export enum TemperatureStatus {
@@ -28,12 +30,38 @@ interface SensorDataInterface {
   deviceId: number;
   heartRate: number;
   temperature: number;
+  signalQuality?: number;
+  qualityFlags?: number;
+  noContact?: boolean;
   gpsLocation?: {
     longitude: number;
     latitude: number;
   };
+  gpsQuality?: {
+    accepted: boolean;
+  };
+  geofence?: {
+    status: number;
+    tableId: number;
+  };
 }
 
+// Zone status codes of the collar's geofence check
+const COLLAR_ZONE_STATUS = [
+  undefined,
+  ZoneStatus.Safe,
+  ZoneStatus.Warning,
+  ZoneStatus.Danger,
+];
+
+// SQI flags from the collar ("qf"). NO_PULSE is good contact without a
+// pulsatile signal, the others mean the sensor could not see the pulse.
+const SQI_FLAG_NO_CONTACT = 1 << 0;
+const SQI_FLAG_CLIPPED = 1 << 1;
+const SQI_FLAG_NO_PULSE = 1 << 2;
+const SQI_FLAG_SETTLING = 1 << 5;
+const SQI_SENSOR_FAULT = SQI_FLAG_NO_CONTACT | SQI_FLAG_CLIPPED | SQI_FLAG_SETTLING;
+
 export class CattleSensorData {
   private static getThresholdValue = async () => {
     const threshold = await ThresholdModel.findById('global');
@@ -54,7 +82,7 @@ export class CattleSensorData {
     const cattleLocationStatus = await this.getZoneStatus(sensor);
 
     if (
-      cattleHeartRateStatus === HeartRateStatus.Safe &&
+      cattleHeartRateStatus !== HeartRateStatus.Danger &&
       cattleTemperatureStatus === TemperatureStatus.Safe &&
       cattleLocationStatus === ZoneStatus.Safe
     ) {
@@ -94,6 +122,11 @@ export class CattleSensorData {
       issues.push('near zone boundary');
     }
 
+    // The collar could not read the heart rate because the sensor is off the skin
+    if (sensor.noContact) {
+      issues.push('collar sensor not touching the skin, check collar fit');
+    }
+
     // Emit a SINGLE combined notification if there are any issues
     if (issues.length > 0) {
       const message = `Cattle ${sensor.deviceId}: ${issues.join(', ')}.`;
@@ -101,7 +134,7 @@ export class CattleSensorData {
     }
 
     if (
-      cattleHeartRateStatus === HeartRateStatus.Safe &&
+      cattleHeartRateStatus !== HeartRateStatus.Danger &&
       cattleTemperatureStatus === TemperatureStatus.Safe &&
       cattleLocationStatus === ZoneStatus.Safe
     ) {
@@ -139,6 +172,19 @@ export class CattleSensorData {
 
     if (!latestSensorData) {
       return HeartRateStatus.Danger;
+    } else if (!(latestSensorData.heartRate > 0)) {
+      // The collar reports 0 when the signal quality was too low to trust the
+      // reading. Only no pulse with good contact is an alarm, a loose collar,
+      // movement or LEDs still settling leave the heart rate unknown.
+      const flags = latestSensorData.qualityFlags || 0;
+      if (
+        !latestSensorData.noContact &&
+        (flags & SQI_FLAG_NO_PULSE) !== 0 &&
+        (flags & SQI_SENSOR_FAULT) === 0
+      ) {
+        return HeartRateStatus.Danger;
+      }
+      return HeartRateStatus.Unknown;
     } else if (
       latestSensorData.heartRate >= (threshold?.heartRate?.min || 0) &&
       latestSensorData.heartRate <= (threshold?.heartRate?.max || 0)
@@ -153,6 +199,18 @@ export class CattleSensorData {
   public static getZoneStatus = async (
     latestSensorData: SensorDataInterface
   ): Promise<ZoneStatus> => {
+    // The collar already checked the fix against the zones in force
+    const collarStatus = latestSensorData?.geofence
+      ? COLLAR_ZONE_STATUS[latestSensorData.geofence.status]
+      : undefined;
+    if (
+      collarStatus &&
+      getGeofenceTableId() !== undefined &&
+      latestSensorData.geofence?.tableId === getGeofenceTableId()
+    ) {
+      return collarStatus;
+    }
+
     const threshold = await this.getThresholdValue();
     const warningBuffer = threshold?.geofence?.threshold || 0;
 
@@ -160,6 +218,9 @@ export class CattleSensorData {
     if (geoFences.length === 0) return ZoneStatus.Safe;
 
     if (!latestSensorData?.gpsLocation) return ZoneStatus.Unknown;
+    // A fix the collar sent only because it timed out is too rough for a breach
+    if (latestSensorData.gpsQuality && !latestSensorData.gpsQuality.accepted)
+      return ZoneStatus.Unknown;
 
     let isInSafe = false;
     let isInWarning = false;
@@ -201,6 +262,21 @@ export class CattleSensorData {
     return ZoneStatus.Danger;
   };
 
+  // ─── MQTT-ONLY zone alert (the collar's check wake between cycles) ───
+  // Same message as the combined notification, the cooldown drops the
+  // repeat when the scheduled uplink follows
+  public static geofenceAlertWithNotify = async (sensor: SensorDataInterface) => {
+    const zoneStatus = await this.getZoneStatus(sensor);
+    if (zoneStatus === ZoneStatus.Danger) {
+      await this.createAndEmitNotification(
+        sensor.deviceId,
+        `Cattle ${sensor.deviceId}: in danger zone or outside safe zones.`,
+        'DANGER'
+      );
+    }
+    return zoneStatus;
+  };
+
   // Keep the old name as an alias so existing API code that calls cattleZoneType still works
   public static cattleZoneType = CattleSensorData.getZoneStatus;
 
@@ -0,0 +1,56 @@
+import geoFenceModel, { ZoneType } from '../model/geoFenceModel';
+import { ThresholdModel } from '../model/sensorThresholdModel';
+
+// Must match the collar's geofence.h
+const GEOFENCE_FRAME = 0xc0;
+const GEOFENCE_MAX = 16;
+const GEOFENCE_ENTRY_SIZE = 11;
+
+let tableId: number | undefined;
+
+// Id of the table the collars hold, undefined when it does not cover every
+// zone and the backend has to check positions itself
+export const getGeofenceTableId = () => tableId;
+
+const clampU16 = (value: number) =>
+  Math.min(Math.max(Math.round(value || 0), 0), 0xffff);
+
+// Downlink frame the gateway broadcasts to the collars:
+// 0xC0, table id (u32), warning buffer (u16 m), count, then per zone
+// lat, lon (i32, 1e-7 degrees), radius (u16 m), type (0 safe, 1 danger).
+// Little endian like the sync beacon.
+export const buildGeofenceFrame = async (): Promise<Buffer> => {
+  const geoFences = await geoFenceModel.find();
+  const threshold = await ThresholdModel.findById('global');
+  const zones = geoFences.slice(0, GEOFENCE_MAX);
+  if (geoFences.length > GEOFENCE_MAX) {
+    console.warn(
+      `${geoFences.length} geofences, the collars only hold the first ${GEOFENCE_MAX}`
+    );
+  }
+
+  const body = Buffer.alloc(3 + zones.length * GEOFENCE_ENTRY_SIZE);
+  body.writeUInt16LE(clampU16(threshold?.geofence?.threshold || 0), 0);
+  body.writeUInt8(zones.length, 2);
+  zones.forEach((zone, i) => {
+    const offset = 3 + i * GEOFENCE_ENTRY_SIZE;
+    body.writeInt32LE(Math.round(zone.latitude * 1e7), offset);
+    body.writeInt32LE(Math.round(zone.longitude * 1e7), offset + 4);
+    body.writeUInt16LE(clampU16(zone.radius), offset + 8);
+    body.writeUInt8(zone.zoneType === ZoneType.DANGER ? 1 : 0, offset + 10);
+  });
+
+  // 32-bit FNV-1a of the content, the collars skip a table they already
+  // hold. 0 means no table on the collar.
+  let hash = 0x811c9dc5;
+  for (const byte of body) {
+    hash = Math.imul(hash ^ byte, 0x01000193) >>> 0;
+  }
+  const id = hash || 1;
+
+  const header = Buffer.alloc(5);
+  header.writeUInt8(GEOFENCE_FRAME, 0);
+  header.writeUInt32LE(id, 1);
+  tableId = geoFences.length > GEOFENCE_MAX ? undefined : id;
+  return Buffer.concat([header, body]);
+};
@@ -6,9 +6,72 @@ import sensorData from '../model/sensorData';
 import path from 'path';
 import fs from 'fs';
 import { getSocketIOInstance } from '../socket';
+import { buildGeofenceFrame } from './geofenceTable';
+import { EVERY_COLLAR } from './collarSettings';
 import console from 'console';
 
 const MQTT_BROKER = process.env.MQTT_BROKER || 'mqtt://localhost';
+// Retained, so the gateway gets the table again when it reconnects
+const GEOFENCE_TOPIC = 'zone/1/geofence';
+// One retained frame per collar (or "all"), the gateway relays them
+const SETTINGS_TOPIC = 'zone/1/settings';
+
+// Zone reference the collars send positions relative to, the gw_lat/gw_lon
+// provisioned on the collars of this zone (degrees)
+const ZONE_REF_LAT = parseFloat(process.env.ZONE_REF_LAT || '');
+const ZONE_REF_LON = parseFloat(process.env.ZONE_REF_LON || '');
+
+// Same as the collar's pos_decode_offset: "dn"/"de" are meters north and
+// east of the reference on a local equirectangular projection. Falls back
+// to the full "la"/"lo" the collar sends when the offsets do not fit.
+const M_PER_DEG = 111194.93;
+const parseGpsLocation = (
+  raw: any
+): SensorDataInterface['gpsLocation'] => {
+  if (raw.dn !== undefined && raw.de !== undefined) {
+    if (isNaN(ZONE_REF_LAT) || isNaN(ZONE_REF_LON)) {
+      console.warn('Relative position received but ZONE_REF_LAT/ZONE_REF_LON are not set');
+      return undefined;
+    }
+    let longitude =
+      ZONE_REF_LON +
+      parseInt(raw.de) / (M_PER_DEG * Math.cos((ZONE_REF_LAT * Math.PI) / 180));
+    if (longitude > 180) longitude -= 360;
+    else if (longitude < -180) longitude += 360;
+    return {
+      latitude: ZONE_REF_LAT + parseInt(raw.dn) / M_PER_DEG,
+      longitude,
+    };
+  }
+  return raw.la && raw.lo
+    ? {
+      latitude: parseFloat(raw.la),
+      longitude: parseFloat(raw.lo),
+    }
+    : undefined;
+};
+
+// HDOP upper bounds of the classes in bits 4-6 of the collar's "gq" byte
+const GPS_HDOP_CLASS_MAX = [undefined, 1, 2, 5, 10, 20, undefined, undefined];
+
+// "gq": bit 7 accepted, bits 4-6 HDOP class, bits 0-3 satellites, 0 = no fix
+const parseGpsQuality = (gq?: string): SensorDataInterface['gpsQuality'] => {
+  if (gq === undefined) return undefined;
+  const q = parseInt(gq);
+  if (!q) return undefined;
+  return {
+    accepted: (q & 0x80) !== 0,
+    satellites: q & 0x0f,
+    maxHdop: GPS_HDOP_CLASS_MAX[(q >> 4) & 0x07],
+  };
+};
+
+// "gf": zone status of the collar's own check (1 safe, 2 warning, 3 danger)
+// against geofence table "gi" (hex)
+const parseGeofence = (raw: any): SensorDataInterface['geofence'] =>
+  raw.gf !== undefined && raw.gi !== undefined
+    ? { status: parseInt(raw.gf), tableId: parseInt(raw.gi, 16) }
+    : undefined;
 
 interface CattleData {
   heartRate: number;
@@ -74,16 +137,51 @@ class MqttHandler {
         const receivedMsg: SensorDataInterface = {
           deviceId: parseInt(raw.i),
           temperature: parseFloat(raw.t),
+          ambientTemperature: raw.ta !== undefined ? parseFloat(raw.ta) : undefined,
+          compensatedTemperature: raw.tc !== undefined ? parseFloat(raw.tc) : undefined,
           heartRate: parseInt(raw.h),
-          gpsLocation:
-            raw.la && raw.lo
+          signalQuality: raw.q !== undefined ? parseInt(raw.q) : undefined,
+          qualityFlags: raw.qf !== undefined ? parseInt(raw.qf) : 0,
+          ledCurrent: raw.lc !== undefined ? parseFloat(raw.lc) : undefined,
+          noContact: raw.nc === '1',
+          hrv:
+            raw.rm !== undefined
               ? {
-                latitude: parseFloat(raw.la),
-                longitude: parseFloat(raw.lo),
+                rmssd: parseInt(raw.rm),
+                sdnn: parseInt(raw.sd),
+                pnn50: parseInt(raw.pn),
               }
               : undefined,
+          respiration:
+            raw.rr !== undefined
+              ? {
+                rate: parseInt(raw.rr),
+                confidence: parseInt(raw.rc),
+              }
+              : undefined,
+          gpsLocation: parseGpsLocation(raw),
+          gpsQuality: parseGpsQuality(raw.gq),
+          gpsAge: raw.ga !== undefined ? parseInt(raw.ga) : undefined,
+          geofence: parseGeofence(raw),
         };
 
+        // Zone change the collar sent from a check wake, position only
+        if (raw.pr === '1') {
+          const zoneStatus = await CattleSensorData.geofenceAlertWithNotify(receivedMsg);
+          const ioInstance = getSocketIOInstance();
+          if (ioInstance) {
+            ioInstance.emit('geofence_alert', {
+              deviceId: receivedMsg.deviceId,
+              gpsLocation: receivedMsg.gpsLocation,
+              zoneStatus,
+              timestamp: new Date().toLocaleString('en-IN', {
+                timeZone: 'Asia/Kolkata',
+              }),
+            });
+          }
+          return;
+        }
+
         const { deviceId, heartRate, temperature, gpsLocation } = receivedMsg;
 
         if (deviceId) {
@@ -213,6 +311,26 @@ class MqttHandler {
     });
   }
 
+  // Send the geofence table to the gateway, call whenever zones or the
+  // warning buffer change
+  public async publishGeofenceTable(): Promise<void> {
+    try {
+      const frame = await buildGeofenceFrame();
+      this.publish(GEOFENCE_TOPIC, frame.toString('hex'), { qos: 1, retain: true });
+    } catch (error) {
+      console.error('Error building the geofence table:', error);
+    }
+  }
+
+  // Send a settings frame from buildSettingsFrame to the gateway
+  public publishCollarSettings(deviceId: number, frame: Buffer): void {
+    const target = deviceId === EVERY_COLLAR ? 'all' : deviceId;
+    this.publish(`${SETTINGS_TOPIC}/${target}`, frame.toString('hex'), {
+      qos: 1,
+      retain: true,
+    });
+  }
+
   public getLatestUpdate(): Record<number, CattleData> {
     return this.latestupdate;
   }
@@ -1,9 +1,34 @@
 export interface SensorDataInterface {
     deviceId: number;
     heartRate: number;
-    temperature: number;
+    temperature: number; // body temperature as read by the probe
+    ambientTemperature?: number;
+    compensatedTemperature?: number; // core estimate from the ambient temperature, once the collar is calibrated
+    signalQuality?: number;
+    qualityFlags?: number; // SQI_FLAG_* reasons the collar gave for a poor window
+    ledCurrent?: number; // IR LED drive of the collar (mA)
+    noContact?: boolean; // heart rate sensor found no skin, collar fit needs checking
+    hrv?: {
+      rmssd: number; // ms
+      sdnn: number; // ms
+      pnn50: number; // %
+    };
+    respiration?: {
+      rate: number; // breaths per minute
+      confidence: number; // 0..100
+    };
     gpsLocation?: {
       latitude: number;
       longitude: number;
     };
+    gpsQuality?: {
+      accepted: boolean; // the fix met the collar's acceptance criteria
+      satellites: number; // 15 means 15 or more
+      maxHdop?: number; // upper bound of the HDOP class, undefined when poor or unknown
+    };
+    gpsAge?: number; // s, set when the collar re-sent an earlier fix for a resting animal
+    geofence?: {
+      status: number; // the collar's zone status: 1 safe, 2 warning, 3 danger
+      tableId: number; // geofence table it was checked against
+    };
   }
\ No newline at end of file